@@ -29,6 +29,7 @@ private:
 	ci::gl::BatchRef	mBatchStockColorSphere;
 	
 	void				addActor();
+	double				mElapsedSeconds;
 	physx::PxMaterial*	mMaterial;
 	PhysxRef			mPhysx;
 	virtual void		onObjectOutOfBounds( physx::PxShape& shape, physx::PxActor& actor ) override;
@@ -61,8 +62,13 @@ BasicApp::BasicApp()
 	// Initialize Physx
 	mPhysx = Physx::create();
 
+	// Step physics at 60Hz regardless of frame rate. Poses are 
+	// interpolated between steps when drawing.
+	mElapsedSeconds = getElapsedSeconds();
+	mPhysx->enableFixedTimestep( 1.0f / 60.0f );
+
 	// Create a material for all actors
-	mMaterial = mPhysx->getPhysics()->createMaterial( 0.5f, 0.5f, 0.5f );
+	mMaterial = mPhysx->getMaterial( 0.5f, 0.5f, 0.5f );
 
 	// Create a scene. Multiples scenes are allowed.
 	mPhysx->createScene();
@@ -119,39 +125,36 @@ BasicApp::BasicApp()
 
 void BasicApp::addActor()
 {
-	// Choose random position and size
+	// Choose random position and one of ten sizes, so actors of the 
+	// same size and type share one cached shape
 	vec3 p( randVec3() * 5.0f );
 	p.y		= glm::abs( p.y );
-	float r = randFloat( 0.01f, 1.0f );
+	float r = (float)randInt( 1, 11 ) * 0.1f;
 	
 	// Create a randomly shaped actor
-	PxRigidDynamic* actor = nullptr;
+	PxShape* shape = nullptr;
 	switch ( randInt( 0, 3 ) ) {
 		case 0:
-			actor = PxCreateDynamic(
-									*mPhysx->getPhysics(),
-									PxTransform( Physx::to( p ) ),
-									PxBoxGeometry( Physx::to( vec3( r ) ) ),
-									*mMaterial,
-									r * 100.0f );
+			shape = mPhysx->getShape( PxBoxGeometry( Physx::to( vec3( r ) ) ), *mMaterial );
 			break;
 		case 1:
-			actor = PxCreateDynamic(
-									*mPhysx->getPhysics(),
-									PxTransform( Physx::to( p ) ),
-									PxSphereGeometry( r ),
-									*mMaterial,
-									r * 100.0f );
+			shape = mPhysx->getShape( PxSphereGeometry( r ), *mMaterial );
 			break;
 		case 2:
-			actor = PxCreateDynamic(
-									*mPhysx->getPhysics(),
-									PxTransform( Physx::to( p ) ),
-									PxCapsuleGeometry( r, r * 0.5f ),
-									*mMaterial,
-									r * 100.0f );
+			shape = mPhysx->getShape( PxCapsuleGeometry( r, r * 0.5f ), *mMaterial );
 			break;
 	}
+	if ( shape == nullptr ) {
+		return;
+	}
+	PxRigidDynamic* actor = PxCreateDynamic( 
+		*mPhysx->getPhysics(), 
+		PxTransform( Physx::to( p ) ), 
+		*shape, 
+		r * 100.0f );
+	if ( actor == nullptr ) {
+		return;
+	}
 	
 	// Apply some motion and add it to the scene
 	actor->setLinearVelocity( Physx::to( randVec3() ) );
@@ -173,7 +176,7 @@ void BasicApp::draw()
 
 			// Apply actor's transform
 			const gl::ScopedModelMatrix scopedModelMatrix;
-			gl::multModelMatrix( Physx::from( actor->getGlobalPose() ) );
+			gl::multModelMatrix( Physx::from( mPhysx->getInterpolatedPose( *actor ) ) );
 		
 			// Get the actor's shapes
 			PxShape* shape = nullptr;
@@ -255,7 +258,9 @@ void BasicApp::resize()
 
 void BasicApp::update()
 {
-	mPhysx->update();
+	double e		= getElapsedSeconds();
+	mPhysx->update( (float)( e - mElapsedSeconds ) );
+	mElapsedSeconds	= e;
 	
 #if defined( CINDER_COCOA_TOUCH )
 	if ( mTouching ) {
@@ -0,0 +1,510 @@
+#include "CinderPhysx.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if defined( __linux__ ) || defined( __APPLE__ )
+#include <sys/resource.h>
+#endif
+
+// Headless benchmark for the Physx wrapper. No window or GL
+// context is created. Each scenario prints one JSON object per
+// line to stdout so runs can be diffed or collected by CI.
+//
+// Usage: Benchmark [--steps N] [--threads N] [--filter substring]
+//                  [--replay recording]
+//
+// --replay plays back a file written by Physx::startRecording() 
+// instead of running the built-in scenarios. Compare "pose_hash" 
+// across builds to check that a replay is bit-exact. Meshes are 
+// cooked again on playback with default flags, so with convex or 
+// triangle meshes the replay can differ from the recorded session.
+
+using namespace ci;
+using namespace physx;
+using namespace std;
+
+namespace
+{
+
+struct Settings
+{
+	Settings()
+	: mNumSteps( 600 ), mNumThreads( 0 ), mNumWarmupSteps( 60 )
+	{
+	}
+
+	string		mFilter;
+	uint32_t	mNumSteps;
+	uint32_t	mNumThreads;
+	uint32_t	mNumWarmupSteps;
+	string		mReplayPath;
+};
+
+struct Result
+{
+	Result()
+	: mNumActors( 0 ), mNumSteps( 0 ), mPoolBytesPeak( 0 ), mPoseHash( 0 ), mSeconds( 0.0 )
+	{
+	}
+
+	string			mName;
+	size_t			mNumActors;
+	uint32_t		mNumSteps;
+	size_t			mPoolBytesPeak;
+	uint64_t		mPoseHash;
+	vector<double>	mSamples;
+	double			mSeconds;
+};
+
+typedef function<void( PhysxRef&, PxMaterial*, Result& )> Scenario;
+
+double getMilliseconds()
+{
+	return chrono::duration<double, milli>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Process-wide, so this only ever grows between scenarios
+size_t getPeakResidentBytes()
+{
+#if defined( __linux__ )
+	rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return (size_t)usage.ru_maxrss * 1024;
+#elif defined( __APPLE__ )
+	rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return (size_t)usage.ru_maxrss;
+#else
+	return 0;
+#endif
+}
+
+double getPercentile( vector<double> samples, double percentile )
+{
+	if ( samples.empty() ) {
+		return 0.0;
+	}
+	size_t index = (size_t)( percentile * (double)( samples.size() - 1 ) + 0.5 );
+	nth_element( samples.begin(), samples.begin() + index, samples.end() );
+	return samples[ index ];
+}
+
+// FNV-1a over every dynamic actor's pose bits
+uint64_t hashPoses( PhysxRef& physx )
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for ( const pair<uint32_t, PxActor*>& iter : physx->getActors() ) {
+		if ( iter.second->getType() == PxActorType::eRIGID_DYNAMIC ) {
+			PxTransform pose		= static_cast<PxRigidDynamic*>( iter.second )->getGlobalPose();
+			const uint8_t* bytes	= (const uint8_t*)&pose;
+			for ( size_t i = 0; i < sizeof( PxTransform ); ++i ) {
+				hash = ( hash ^ bytes[ i ] ) * 1099511628211ULL;
+			}
+		}
+	}
+	return hash;
+}
+
+void addGround( PhysxRef& physx, PxMaterial* material )
+{
+	physx->addActor( PxCreatePlane( *physx->getPhysics(), PxPlane( PxVec3( 0.0f, 1.0f, 0.0f ), 0.0f ), *material ), physx->getScene() );
+}
+
+PxRigidDynamic* createBox( PhysxRef& physx, PxMaterial* material, const vec3& position, float halfExtent )
+{
+	return PxCreateDynamic( *physx->getPhysics(), PxTransform( Physx::to( position ) ),
+							PxBoxGeometry( halfExtent, halfExtent, halfExtent ), *material, 10.0f );
+}
+
+PxRigidDynamic* createSphere( PhysxRef& physx, PxMaterial* material, const vec3& position, float radius )
+{
+	return PxCreateDynamic( *physx->getPhysics(), PxTransform( Physx::to( position ) ),
+							PxSphereGeometry( radius ), *material, 10.0f );
+}
+
+// Drops count spheres from a jittered grid so they settle into a pile. 
+// With sharedShape set they all use one cached shape.
+void addSpherePile( PhysxRef& physx, PxMaterial* material, size_t count, bool sharedShape = false )
+{
+	const float radius	= 0.25f;
+	PxShape* shape		= sharedShape ? physx->getShape( PxSphereGeometry( radius ), *material ) : nullptr;
+	const size_t side	= (size_t)ceil( sqrt( (double)count / 10.0 ) );
+	vector<PxActor*> actors;
+	actors.reserve( count );
+	for ( size_t i = 0; i < count; ++i ) {
+		size_t x	= i % side;
+		size_t z	= ( i / side ) % side;
+		size_t y	= i / ( side * side );
+		float j		= ( i % 7 ) * 0.01f;
+		vec3 p( ( (float)x - (float)side * 0.5f ) * radius * 2.2f + j,
+				radius + (float)y * radius * 2.2f,
+				( (float)z - (float)side * 0.5f ) * radius * 2.2f - j );
+		if ( shape != nullptr ) {
+			actors.push_back( PxCreateDynamic( *physx->getPhysics(), PxTransform( Physx::to( p ) ), *shape, 10.0f ) );
+		} else {
+			actors.push_back( createSphere( physx, material, p, radius ) );
+		}
+	}
+	physx->addActors( actors, physx->getScene() );
+}
+
+void runSimulation( PhysxRef& physx, const Settings& settings, Result& result,
+					const function<void()>& perStep = function<void()>() )
+{
+	for ( uint32_t i = 0; i < settings.mNumWarmupSteps; ++i ) {
+		physx->update();
+	}
+
+	result.mSamples.reserve( settings.mNumSteps );
+	double start = getMilliseconds();
+	for ( uint32_t i = 0; i < settings.mNumSteps; ++i ) {
+		double t = getMilliseconds();
+		if ( perStep ) {
+			perStep();
+		}
+		physx->update();
+		result.mSamples.push_back( getMilliseconds() - t );
+	}
+	result.mSeconds		= ( getMilliseconds() - start ) / 1000.0;
+	result.mNumSteps	= settings.mNumSteps;
+	result.mNumActors	= physx->getActors().size();
+	result.mPoseHash	= hashPoses( physx );
+}
+
+Scenario spherePile( size_t count, bool sharedShape, const Settings& settings )
+{
+	return [ count, sharedShape, &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		addSpherePile( physx, material, count, sharedShape );
+		runSimulation( physx, settings, result );
+	};
+}
+
+// Columns of boxes resting on each other, which stresses the solver
+// rather than the broadphase
+Scenario boxStacks( size_t numStacks, size_t height, const Settings& settings )
+{
+	return [ numStacks, height, &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		const float halfExtent	= 0.5f;
+		const size_t side		= (size_t)ceil( sqrt( (double)numStacks ) );
+		vector<PxActor*> actors;
+		actors.reserve( numStacks * height );
+		for ( size_t i = 0; i < numStacks; ++i ) {
+			float x = ( (float)( i % side ) - (float)side * 0.5f ) * halfExtent * 6.0f;
+			float z = ( (float)( i / side ) - (float)side * 0.5f ) * halfExtent * 6.0f;
+			for ( size_t j = 0; j < height; ++j ) {
+				vec3 p( x, halfExtent + (float)j * halfExtent * 2.0f, z );
+				actors.push_back( createBox( physx, material, p, halfExtent ) );
+			}
+		}
+		physx->addActors( actors, physx->getScene() );
+		runSimulation( physx, settings, result );
+	};
+}
+
+// Erases the oldest actors and spawns replacements every step, which
+// measures deferred deletion and actor ID recycling. Pooled runs take
+// replacements from the actor pool instead of creating them.
+Scenario spawnEraseChurn( size_t count, size_t perStep, bool pooled, const Settings& settings )
+{
+	return [ count, perStep, pooled, &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		addSpherePile( physx, material, count );
+
+		size_t n = 0;
+		runSimulation( physx, settings, result, [ &physx, material, perStep, pooled, &n ]()
+		{
+			const vector<pair<uint32_t, PxActor*>>& actors = physx->getActors();
+			for ( size_t i = 0, erased = 0; i < actors.size() && erased < perStep; ++i ) {
+				if ( actors[ i ].second->getType() == PxActorType::eRIGID_DYNAMIC ) {
+					physx->eraseActor( actors[ i ].first );
+					++erased;
+				}
+			}
+			vector<PxActor*> spawned;
+			spawned.reserve( perStep );
+			for ( size_t i = 0; i < perStep; ++i, ++n ) {
+				vec3 p( (float)( n % 40 ) * 0.6f - 12.0f, 20.0f, (float)( ( n / 40 ) % 40 ) * 0.6f - 12.0f );
+				if ( pooled ) {
+					spawned.push_back( physx->createPooledActor( PxSphereGeometry( 0.25f ), *material, 
+																 PxTransform( Physx::to( p ) ), 10.0f ) );
+				} else {
+					spawned.push_back( createSphere( physx, material, p, 0.25f ) );
+				}
+			}
+			physx->addActors( spawned, physx->getScene() );
+		} );
+	};
+}
+
+// The same churn driven from worker threads through the command queue. 
+// Each worker erases its oldest spheres and queues new ones while the 
+// main thread only steps. Add order varies, so pose_hash does too.
+Scenario spawnEraseQueued( size_t count, size_t perStep, size_t numWorkers, const Settings& settings )
+{
+	return [ count, perStep, numWorkers, &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		addSpherePile( physx, material, count );
+
+		vector<deque<uint32_t>> owned( numWorkers );
+		size_t numOwned = 0;
+		for ( const pair<uint32_t, PxActor*>& iter : physx->getActors() ) {
+			if ( iter.second->getType() == PxActorType::eRIGID_DYNAMIC ) {
+				owned[ numOwned++ % numWorkers ].push_back( iter.first );
+			}
+		}
+
+		size_t n = 0;
+		runSimulation( physx, settings, result, [ &physx, material, perStep, numWorkers, &owned, &n ]()
+		{
+			size_t quota = perStep / numWorkers;
+			vector<thread> workers;
+			for ( size_t w = 0; w < numWorkers; ++w ) {
+				workers.push_back( thread( [ &physx, material, quota, &owned, n, w ]()
+				{
+					deque<uint32_t>& ids = owned[ w ];
+					for ( size_t i = 0; i < quota && !ids.empty(); ++i ) {
+						physx->queueEraseActor( ids.front() );
+						ids.pop_front();
+					}
+					for ( size_t i = 0; i < quota; ++i ) {
+						size_t k = n + w * quota + i;
+						vec3 p( (float)( k % 40 ) * 0.6f - 12.0f, 20.0f, (float)( ( k / 40 ) % 40 ) * 0.6f - 12.0f );
+						PxRigidDynamic* actor	= createSphere( physx, material, p, 0.25f );
+						uint32_t id				= physx->queueAddActor( actor );
+						if ( id == Physx::kInvalidId ) {
+							actor->release();
+						} else {
+							ids.push_back( id );
+						}
+					}
+				} ) );
+			}
+			for ( thread& worker : workers ) {
+				worker.join();
+			}
+			n += quota * numWorkers;
+		} );
+	};
+}
+
+// Samples are per-mesh cook times rather than step times
+Scenario meshCooking( size_t count, size_t resolution )
+{
+	return [ count, resolution ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		// A displaced grid for triangle meshes and a point cloud
+		// on a sphere for convex hulls
+		vector<vec3> grid;
+		vector<uint32_t> indices;
+		vector<vec3> hull;
+		for ( size_t z = 0; z <= resolution; ++z ) {
+			for ( size_t x = 0; x <= resolution; ++x ) {
+				float h = sin( (float)x * 0.3f ) * cos( (float)z * 0.3f );
+				grid.push_back( vec3( (float)x, h, (float)z ) );
+				if ( x < resolution && z < resolution ) {
+					uint32_t i = (uint32_t)( z * ( resolution + 1 ) + x );
+					uint32_t w = (uint32_t)( resolution + 1 );
+					uint32_t quad[] = { i, i + w, i + 1, i + 1, i + w, i + w + 1 };
+					indices.insert( indices.end(), quad, quad + 6 );
+				}
+			}
+		}
+		for ( size_t i = 0; i < resolution * 4; ++i ) {
+			float t = (float)i * 2.399963f;
+			float y = 1.0f - 2.0f * ( (float)i + 0.5f ) / (float)( resolution * 4 );
+			float r = sqrt( 1.0f - y * y );
+			hull.push_back( vec3( cos( t ) * r, y, sin( t ) * r ) );
+		}
+
+		double start = getMilliseconds();
+		for ( size_t i = 0; i < count; ++i ) {
+			double t = getMilliseconds();
+			PxTriangleMesh* triangleMesh = physx->createTriangleMesh( grid, indices.size() / 3, indices );
+			PxConvexMesh* convexMesh = physx->createConvexMesh( hull );
+			result.mSamples.push_back( getMilliseconds() - t );
+			if ( triangleMesh != nullptr ) {
+				triangleMesh->release();
+			}
+			if ( convexMesh != nullptr ) {
+				convexMesh->release();
+			}
+		}
+		result.mSeconds		= ( getMilliseconds() - start ) / 1000.0;
+		result.mNumSteps	= (uint32_t)count;
+	};
+}
+
+// Samples are the cost of pulling every pose out as a matrix after a 
+// step, once through PxTransform arrays and once through instance 
+// buckets. The step itself isn't timed.
+Scenario poseExtraction( size_t count, const Settings& settings )
+{
+	return [ count, &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		addSpherePile( physx, material, count );
+		for ( uint32_t i = 0; i < settings.mNumWarmupSteps; ++i ) {
+			physx->update();
+		}
+
+		vector<PxTransform> transforms;
+		vector<mat4> matrices;
+		vector<Physx::InstanceBuckets::Instance> instances;
+		Physx::InstanceBuckets buckets;
+		double start = getMilliseconds();
+		for ( uint32_t i = 0; i < settings.mNumSteps; ++i ) {
+			physx->update();
+			double t = getMilliseconds();
+			const vector<pair<uint32_t, PxActor*>>& actors = physx->getActors();
+			transforms.clear();
+			for ( const pair<uint32_t, PxActor*>& iter : actors ) {
+				if ( iter.second->getType() == PxActorType::eRIGID_DYNAMIC ) {
+					transforms.push_back( static_cast<PxRigidDynamic*>( iter.second )->getGlobalPose() );
+				}
+			}
+			matrices.resize( transforms.size() );
+			Physx::from( transforms.data(), matrices.data(), transforms.size() );
+			physx->getInstances( buckets );
+			instances.resize( buckets.getNumInstances( PxGeometryType::eSPHERE ) );
+			buckets.write( PxGeometryType::eSPHERE, instances.data(), instances.size() );
+			result.mSamples.push_back( getMilliseconds() - t );
+		}
+		result.mSeconds		= ( getMilliseconds() - start ) / 1000.0;
+		result.mNumSteps	= settings.mNumSteps;
+		result.mNumActors	= physx->getActors().size();
+	};
+}
+
+// Samples are the time each recorded update takes to replay, 
+// including the calls recorded ahead of it
+Scenario replay( const Settings& settings )
+{
+	return [ &settings ]( PhysxRef& physx, PxMaterial* material, Result& result )
+	{
+		Physx::Player player( *physx, settings.mReplayPath );
+		double start = getMilliseconds();
+		while ( !player.isFinished() ) {
+			double t = getMilliseconds();
+			if ( player.step() ) {
+				result.mSamples.push_back( getMilliseconds() - t );
+			}
+		}
+		if ( !player.isValid() ) {
+			cerr << "Recording " << settings.mReplayPath << " is invalid or truncated" << endl;
+		}
+		result.mSeconds		= ( getMilliseconds() - start ) / 1000.0;
+		result.mNumSteps	= (uint32_t)player.getNumUpdates();
+		result.mNumActors	= physx->getActors().size();
+		result.mPoseHash	= hashPoses( physx );
+	};
+}
+
+void printResult( const Result& result )
+{
+	double p50		= getPercentile( result.mSamples, 0.5 );
+	double p99		= getPercentile( result.mSamples, 0.99 );
+	double perSec	= result.mSeconds > 0.0 ? (double)result.mNumSteps / result.mSeconds : 0.0;
+
+	ostringstream ss;
+	ss << fixed << setprecision( 4 );
+	ss << "{\"scenario\":\"" << result.mName << "\""
+	   << ",\"actors\":" << result.mNumActors
+	   << ",\"steps\":" << result.mNumSteps
+	   << ",\"seconds\":" << result.mSeconds
+	   << ",\"steps_per_second\":" << perSec
+	   << ",\"p50_ms\":" << p50
+	   << ",\"p99_ms\":" << p99
+	   << ",\"pool_bytes_peak\":" << result.mPoolBytesPeak
+	   << ",\"rss_bytes_peak\":" << getPeakResidentBytes()
+	   << ",\"pose_hash\":\"" << hex << setw( 16 ) << setfill( '0' ) << result.mPoseHash << "\""
+	   << "}";
+	cout << ss.str() << endl;
+}
+
+Settings parseSettings( int argc, char** argv )
+{
+	Settings settings;
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		if ( strcmp( argv[ i ], "--steps" ) == 0 ) {
+			settings.mNumSteps = (uint32_t)max( atoi( argv[ i + 1 ] ), 1 );
+		} else if ( strcmp( argv[ i ], "--threads" ) == 0 ) {
+			settings.mNumThreads = (uint32_t)max( atoi( argv[ i + 1 ] ), 0 );
+		} else if ( strcmp( argv[ i ], "--filter" ) == 0 ) {
+			settings.mFilter = argv[ i + 1 ];
+		} else if ( strcmp( argv[ i ], "--replay" ) == 0 ) {
+			settings.mReplayPath = argv[ i + 1 ];
+		}
+	}
+	return settings;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	Settings settings = parseSettings( argc, argv );
+
+	// Recordings bring their own scenes
+	bool replaying = !settings.mReplayPath.empty();
+
+	vector<pair<string, Scenario>> scenarios;
+	if ( replaying ) {
+		scenarios.push_back( make_pair( "replay",			replay( settings ) ) );
+	} else {
+		scenarios.push_back( make_pair( "spheres_2k",		spherePile( 2000, false, settings ) ) );
+		scenarios.push_back( make_pair( "spheres_10k",		spherePile( 10000, false, settings ) ) );
+		scenarios.push_back( make_pair( "spheres_10k_shared",	spherePile( 10000, true, settings ) ) );
+		scenarios.push_back( make_pair( "spheres_50k",		spherePile( 50000, false, settings ) ) );
+		scenarios.push_back( make_pair( "box_stacks",		boxStacks( 64, 32, settings ) ) );
+		scenarios.push_back( make_pair( "spawn_erase_churn",	spawnEraseChurn( 10000, 250, false, settings ) ) );
+		scenarios.push_back( make_pair( "spawn_erase_pooled",	spawnEraseChurn( 10000, 250, true, settings ) ) );
+		scenarios.push_back( make_pair( "spawn_erase_queued",	spawnEraseQueued( 10000, 250, 4, settings ) ) );
+		scenarios.push_back( make_pair( "mesh_cooking",		meshCooking( 32, 64 ) ) );
+		scenarios.push_back( make_pair( "pose_extraction",	poseExtraction( 10000, settings ) ) );
+	}
+
+	for ( const pair<string, Scenario>& scenario : scenarios ) {
+		if ( !settings.mFilter.empty() && scenario.first.find( settings.mFilter ) == string::npos ) {
+			continue;
+		}
+
+		// Each scenario gets its own SDK instance so pool
+		// allocator peaks don't carry over
+		Physx::Options options;
+		options.connectToPvd( false ).poolAllocator( true );
+		if ( scenario.first == "spawn_erase_queued" ) {
+			options.commandQueueSize( 4096 );
+		}
+		if ( settings.mNumThreads > 0 ) {
+			options.numThreads( settings.mNumThreads );
+		}
+		PhysxRef physx			= Physx::create( options );
+		PxMaterial* material	= physx->getPhysics()->createMaterial( 0.5f, 0.5f, 0.1f );
+		if ( !replaying ) {
+			physx->createScene();
+			addGround( physx, material );
+		}
+
+		Result result;
+		result.mName = scenario.first;
+		scenario.second( physx, material, result );
+		if ( physx->getPoolAllocator() != nullptr ) {
+			result.mPoolBytesPeak = physx->getPoolAllocator()->getTotalStats().mBytesPeak;
+		}
+		printResult( result );
+
+		physx->endUpdate();
+		material->release();
+	}
+
+	return 0;
+}
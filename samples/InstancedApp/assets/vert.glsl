@@ -1,6 +1,8 @@
 uniform mat4	ciModelView;
 uniform mat4	ciModelViewProjection;
-#if !defined( INSTANCED_MODEL )
+#if defined( INSTANCED_MODEL )
+uniform mat4	ciViewMatrix;
+#else
 uniform mat3	ciNormalMatrix;
 #endif
 in vec4			ciPosition;
@@ -24,7 +26,7 @@ void main( void )
 	vertex.color		= ciColor.rgb;
 
 #if defined( INSTANCED_MODEL )
-	mat3 normalMatrix	= vInstanceNormalMatrix;
+	mat3 normalMatrix	= mat3( ciViewMatrix ) * vInstanceNormalMatrix;
 #else
 	mat3 normalMatrix	= ciNormalMatrix;
 #endif
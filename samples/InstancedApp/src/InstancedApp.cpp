@@ -3,7 +3,6 @@
 #include "cinder/CameraUi.h"
 #include "cinder/gl/gl.h"
 
-#include "Model.h"
 #include "CinderPhysx.h"
 
 class InstancedApp : public ci::app::App, public physx::PxBroadPhaseCallback
@@ -29,7 +28,11 @@ private:
 	ci::gl::BatchRef	mBatchStockColorPlane;
 	ci::gl::BatchRef	mBatchInstancedSphere;
 
-	void				addActor();
+	Physx::InstanceBuckets	mInstanceBuckets;
+	size_t					mNumSpheres;
+	std::vector<uint32_t>	mOutOfBounds;
+
+	void				addActors( size_t count = 1 );
 	physx::PxMaterial*	mMaterial;
 	PhysxRef			mPhysx;
 	virtual void		onObjectOutOfBounds( physx::PxShape& shape, physx::PxActor& actor ) override;
@@ -53,6 +56,7 @@ InstancedApp::InstancedApp()
 #if defined( CINDER_COCOA_TOUCH )
 	mTouching = false;
 #endif
+	mNumSpheres = 0;
 	
 	mCamera	= CameraPersp( getWindowWidth(), getWindowHeight(), 60.0f, 0.01f, 1000.0f );
 	mCamera.lookAt( vec3( 0.0f, 0.0f, 30.0f ), vec3( 0.0f, 0.0f, 0.0f ) );
@@ -62,7 +66,7 @@ InstancedApp::InstancedApp()
 	mPhysx = Physx::create();
 
 	// Create a material for all actors
-	mMaterial = mPhysx->getPhysics()->createMaterial( 0.5f, 0.5f, 0.5f );
+	mMaterial = mPhysx->getMaterial( 0.5f, 0.5f, 0.5f );
 
 	// Create a scene. Multiples scenes are allowed.
 	mPhysx->createScene();
@@ -80,12 +84,10 @@ InstancedApp::InstancedApp()
 	
 	// Add some spheres
 #if defined( CINDER_COCOA_TOUCH )
-	for ( size_t i = 0; i < 500; ++i ) {
+	addActors( 500 );
 #else
-	for ( size_t i = 0; i < 2000; ++i ) {
+	addActors( 2000 );
 #endif
-		addActor();
-	}
 
 	// Shortcut for shader loading and error handling
 	auto loadGlslProg = [ &]( const gl::GlslProg::Format& format ) -> gl::GlslProgRef
@@ -133,7 +135,7 @@ InstancedApp::InstancedApp()
 
 	// Initialize instancing data
 	geom::BufferLayout bufferLayout;
-	size_t stride = sizeof( Model );
+	size_t stride = sizeof( Physx::InstanceBuckets::Instance );
 	bufferLayout.append( geom::Attrib::CUSTOM_0, 16, stride, 0, 1 );
 	bufferLayout.append( geom::Attrib::CUSTOM_1, 9, stride, sizeof( mat4 ), 1 );
 	mVboInstancedSpheres = gl::Vbo::create( GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW );
@@ -158,24 +160,30 @@ InstancedApp::InstancedApp()
 	gl::enableVerticalSync();
 }
 
-void InstancedApp::addActor()
+void InstancedApp::addActors( size_t count )
 {
-	// Choose random position and size
-	vec3 p( randVec3() * 5.0f );
-	p.y = glm::abs( p.y );
-	float r = randFloat( 0.01f, 1.0f );
+	vector<PxActor*> actors;
+	actors.reserve( count );
+	for ( size_t i = 0; i < count; ++i ) {
+
+		// Choose random position and size. Sizes come in steps so 
+		// erased actors can be recycled from the pool.
+		vec3 p( randVec3() * 5.0f );
+		p.y = glm::abs( p.y );
+		float r = (float)randInt( 1, 11 ) * 0.1f;
+
+		// Get a sphere from the pool and apply some motion
+		PxRigidDynamic* actor = mPhysx->createPooledActor(
+			PxSphereGeometry( r ),
+			*mMaterial,
+			PxTransform( Physx::to( p ) ),
+			r * 100.0f,
+			randVec3() );
+		actors.push_back( actor );
+	}
 
-	// Create a randomly shaped actor
-	PxRigidDynamic* actor = PxCreateDynamic(
-		*mPhysx->getPhysics(),
-		PxTransform( Physx::to( p ) ),
-		PxSphereGeometry( r ),
-		*mMaterial,
-		r * 100.0f );
-
-	// Apply some motion and add it to the scene
-	actor->setLinearVelocity( Physx::to( randVec3() ) );
-	mPhysx->addActor( actor, mPhysx->getScene() );
+	// Add all actors to the scene in one batch
+	mPhysx->addActors( actors, mPhysx->getScene() );
 }
 
 void InstancedApp::draw()
@@ -194,7 +202,7 @@ void InstancedApp::draw()
 	}
 
 	// Draw instanced spheres
-	mBatchInstancedSphere->drawInstanced( (GLsizei)mPhysx->getActors().size() - 1 );
+	mBatchInstancedSphere->drawInstanced( (GLsizei)mNumSpheres );
 }
 
 #if defined( CINDER_COCOA_TOUCH )
@@ -215,12 +223,7 @@ void InstancedApp::keyDown( ci::app::KeyEvent event )
 {
 	switch ( event.getCode() ) {
 	case KeyEvent::KEY_SPACE:
-		{
-			int32_t count = randInt( 10 );
-			for ( size_t i = 0; i < count; ++i ) {
-				addActor();
-			}
-		}
+		addActors( (size_t)randInt( 10 ) );
 		break;
 	case KeyEvent::KEY_f:
 		setFullScreen( !isFullScreen() );
@@ -235,8 +238,10 @@ void InstancedApp::keyDown( ci::app::KeyEvent event )
 
 void InstancedApp::onObjectOutOfBounds( physx::PxShape& shape, physx::PxActor& actor )
 {
-	mPhysx->eraseActor( actor );
-	addActor();
+	// Called from inside the fetch, whose transforms still include this 
+	// actor. It's erased in update() once those have been used.
+	uintptr_t id = (uintptr_t)actor.userData;
+	mOutOfBounds.push_back( (uint32_t)id );
 }
 
 void InstancedApp::onObjectOutOfBounds( PxAggregate& aggregate )
@@ -251,25 +256,38 @@ void InstancedApp::resize()
 
 void InstancedApp::update()
 {
-	mPhysx->update();
+	// Collect the step started at the end of the last frame
+	mPhysx->endUpdate();
 
 #if defined( CINDER_COCOA_TOUCH )
 	if ( mTouching ) {
-		addActor();
+		addActors();
 	}
 #endif
 	
-	vector<Model> spheres;
-	for ( const auto& iter : mPhysx->getActors() ) {
-		if ( iter.second->getType() == PxActorType::eRIGID_DYNAMIC ) {
-			PxRigidDynamic* actor = static_cast<PxRigidDynamic*>( iter.second );
-			mat4 m = glm::scale( Physx::from( actor->getGlobalPose() ), Physx::from( actor->getWorldBounds() ).getSize() );
-			spheres.push_back( Model()
-				.modelMatrix( m )
-				.normalMatrix( glm::inverseTranspose( mat3( mCamera.getViewMatrix() * m ) ) ) );
-		}
+	// Sort shapes into buckets by geometry type and write the spheres 
+	// straight into the instance buffer
+	mPhysx->getInstances( mInstanceBuckets );
+	mNumSpheres = mInstanceBuckets.getNumInstances( PxGeometryType::eSPHERE );
+	size_t size = sizeof( Physx::InstanceBuckets::Instance ) * mNumSpheres;
+	if ( mVboInstancedSpheres->getSize() < size ) {
+		mVboInstancedSpheres->bufferData( size, nullptr, GL_DYNAMIC_DRAW );
+	}
+	if ( mNumSpheres > 0 ) {
+		void* data	= mVboInstancedSpheres->mapReplace();
+		mNumSpheres	= mInstanceBuckets.write( PxGeometryType::eSPHERE, data, mNumSpheres );
+		mVboInstancedSpheres->unmap();
 	}
-	mVboInstancedSpheres->bufferData( sizeof( Model ) * spheres.size(), spheres.data(), GL_DYNAMIC_DRAW );
+
+	// Replace actors that left the world
+	for ( uint32_t id : mOutOfBounds ) {
+		mPhysx->eraseActor( id );
+	}
+	addActors( mOutOfBounds.size() );
+	mOutOfBounds.clear();
+
+	// Start the next step. It runs on the worker threads while this frame draws.
+	mPhysx->beginUpdate();
 }
 
 
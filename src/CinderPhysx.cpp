@@ -4,49 +4,322 @@
 #include "cinder/Log.h"
 #include "cinder/System.h"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined( CINDER_MSW )
+#include <malloc.h>
+#include <windows.h>
+#else
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+#define CINDER_PHYSX_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined( _MSC_VER )
+#define CINDER_PHYSX_CACHE_ALIGNED __declspec( align( 64 ) )
+#else
+#define CINDER_PHYSX_CACHE_ALIGNED __attribute__( ( aligned( 64 ) ) )
+#endif
+
 using namespace ci;
 using namespace physx;
 using namespace physx::debugger;
 using namespace physx::debugger::comm;
 using namespace std;
 
-PxFilterFlags FilterShader(
-	PxFilterObjectAttributes attributes0, PxFilterData filterData0,
-	PxFilterObjectAttributes attributes1, PxFilterData filterData1,
-	PxPairFlags& pairFlags, const void* constantBlock, PxU32 constantBlockSize )
+// Actor IDs pack a slot index in the low bits and the slot's generation 
+// in the high bits. A slot is retired once its generation runs out so 
+// a stale ID can never alias a newer actor. The last slot is never 
+// used, as its final generation would encode to kInvalidId.
+static const uint32_t	kActorIndexBits			= 20;
+static const uint32_t	kActorIndexMask			= ( 1 << kActorIndexBits ) - 1;
+static const uint32_t	kActorGenerationMax		= ( 1 << ( 32 - kActorIndexBits ) ) - 1;
+static const size_t		kActorInvalid			= (size_t)-1;
+static const uint32_t	kActorSlotInUse			= 0xffffffff;
+
+// Pool blocks come in power-of-two classes from 16 bytes to 4KB, 
+// header included, carved out of 64KB chunks. Anything bigger goes 
+// straight to the heap.
+static const uint32_t	kPoolNumClasses			= 9;
+static const uint32_t	kPoolClassLarge			= 0xffffffff;
+static const size_t		kPoolChunkSize			= 64 * 1024;
+static const size_t		kPoolMinBlockSize		= 16;
+
+// Distinct type names the pool keeps counters for. Anything past this 
+// is counted under one shared overflow entry.
+static const uint32_t	kPoolMaxTypes			= 512;
+
+// Queries issued per PxBatchQuery execute, and the smallest batch worth 
+// splitting across workers
+static const size_t		kQueryChunkSize			= 256;
+
+// Matches PhysX's default wake counter reset value, so a recycled 
+// actor starts out awake like a new one
+static const float		kActorWakeCounter		= 0.4f;
+
+// Recordings start with "CPXR" and a format version
+static const uint32_t	kRecordMagic			= 0x52585043;
+static const uint32_t	kRecordVersion			= 1;
+
+namespace {
+
+// 64-bit FNV-1a. Used to key the cooking cache by mesh content.
+class Hash
 {
-	pairFlags = PxPairFlag::eTRIGGER_DEFAULT | PxPairFlag::eCONTACT_DEFAULT | PxPairFlag::eNOTIFY_TOUCH_FOUND;
-	return PxFilterFlag::eDEFAULT;
+public:
+	Hash( uint64_t seed = 14695981039346656037ULL )
+	: mValue( seed )
+	{
+	}
+
+	Hash& add( const void* data, size_t size )
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for ( size_t i = 0; i < size; ++i ) {
+			mValue ^= bytes[ i ];
+			mValue *= 1099511628211ULL;
+		}
+		return *this;
+	}
+
+	template<typename T>
+	Hash& add( const T& value )
+	{
+		return add( &value, sizeof( T ) );
+	}
+
+	Hash& add( const PxBoundedData& data, size_t elementSize )
+	{
+		add( data.count );
+		const uint8_t* bytes = (const uint8_t*)data.data;
+		for ( PxU32 i = 0; i < data.count && bytes != nullptr; ++i, bytes += data.stride ) {
+			add( bytes, elementSize );
+		}
+		return *this;
+	}
+
+	uint64_t getValue() const
+	{
+		return mValue;
+	}
+private:
+	uint64_t mValue;
+};
+
+// Only these can belong to a simulated rigid dynamic
+bool isPoolable( const PxGeometry& geometry )
+{
+	switch ( geometry.getType() ) {
+	case PxGeometryType::eBOX:
+	case PxGeometryType::eCAPSULE:
+	case PxGeometryType::eCONVEXMESH:
+	case PxGeometryType::eSPHERE:
+		return true;
+	default:
+		return false;
+	}
 }
 
-#if defined( CINDER_COCOA_TOUCH )
-PhysxRef Physx::create()
+// Read-only view of a whole file, memory-mapped where possible
+class MappedFile
+{
+public:
+	// Copy-on-write mappings can be patched in place without 
+	// touching the file on disk
+	MappedFile( const fs::path& path, bool copyOnWrite = false )
+	: mData( nullptr ), mSize( 0 )
+	{
+#if defined( CINDER_MSW )
+		mFile		= INVALID_HANDLE_VALUE;
+		mMapping	= nullptr;
+		mFile		= CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+								   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( mFile == INVALID_HANDLE_VALUE ) {
+			return;
+		}
+		LARGE_INTEGER size;
+		if ( !GetFileSizeEx( mFile, &size ) || size.QuadPart == 0 ) {
+			return;
+		}
+		mMapping = CreateFileMappingW( mFile, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr );
+		if ( mMapping != nullptr ) {
+			mData = MapViewOfFile( mMapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0 );
+			mSize = mData != nullptr ? (size_t)size.QuadPart : 0;
+		}
+#else
+		mFile = open( path.string().c_str(), O_RDONLY );
+		if ( mFile < 0 ) {
+			return;
+		}
+		struct stat info;
+		if ( fstat( mFile, &info ) != 0 || info.st_size == 0 ) {
+			return;
+		}
+		int protection	= copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+		void* data		= mmap( nullptr, (size_t)info.st_size, protection, MAP_PRIVATE, mFile, 0 );
+		if ( data != MAP_FAILED ) {
+			mData = data;
+			mSize = (size_t)info.st_size;
+		}
+#endif
+	}
+
+	~MappedFile()
+	{
+#if defined( CINDER_MSW )
+		if ( mData != nullptr ) {
+			UnmapViewOfFile( mData );
+		}
+		if ( mMapping != nullptr ) {
+			CloseHandle( mMapping );
+		}
+		if ( mFile != INVALID_HANDLE_VALUE ) {
+			CloseHandle( mFile );
+		}
+#else
+		if ( mData != nullptr ) {
+			munmap( mData, mSize );
+		}
+		if ( mFile >= 0 ) {
+			close( mFile );
+		}
+#endif
+	}
+
+	PxU8* getData() const
+	{
+		return (PxU8*)mData;
+	}
+
+	PxU32 getSize() const
+	{
+		return (PxU32)mSize;
+	}
+
+	bool isValid() const
+	{
+		return mData != nullptr;
+	}
+private:
+	MappedFile( const MappedFile& );
+	MappedFile& operator=( const MappedFile& );
+
+	void*	mData;
+#if defined( CINDER_MSW )
+	HANDLE	mFile;
+	HANDLE	mMapping;
+#else
+	int		mFile;
+#endif
+	size_t	mSize;
+};
+
+uint64_t hashCookingParams( const PxCookingParams& params )
 {
-	return create( PxTolerancesScale() );
+	// Hash fields one by one since the struct has padding
+	return Hash()
+		.add( (uint32_t)PX_PHYSICS_VERSION )
+		.add( (uint32_t)params.targetPlatform )
+		.add( params.skinWidth )
+		.add( params.suppressTriangleMeshRemapTable )
+		.add( params.buildTriangleAdjacencies )
+		.add( (uint32_t)params.meshPreprocessParams )
+		.add( params.meshWeldTolerance )
+		.add( params.scale.length )
+		.add( params.scale.mass )
+		.add( params.scale.speed )
+		.getValue();
 }
 
-PhysxRef Physx::create( const PxTolerancesScale& scale )
+// Mesh keys cover every field the cooker reads
+uint64_t hashMeshDesc( const PxConvexMeshDesc& desc )
 {
-	PxCookingParams params( scale );
-	params.meshWeldTolerance	= 0.001f;
-	params.meshPreprocessParams = PxMeshPreprocessingFlags(
-														   PxMeshPreprocessingFlag::eWELD_VERTICES					|
-														   PxMeshPreprocessingFlag::eREMOVE_UNREFERENCED_VERTICES	|
-														   PxMeshPreprocessingFlag::eREMOVE_DUPLICATED_TRIANGLES );
-	return PhysxRef( new Physx( scale, params ) );
+	size_t indexSize = desc.flags & PxConvexFlag::e16_BIT_INDICES ? sizeof( PxU16 ) : sizeof( PxU32 );
+	return Hash()
+		.add( desc.points, sizeof( PxVec3 ) )
+		.add( desc.polygons, sizeof( PxHullPolygon ) )
+		.add( desc.indices, indexSize )
+		.add( (uint16_t)desc.flags )
+		.add( desc.vertexLimit )
+		.getValue();
 }
 
-PhysxRef Physx::create( const PxTolerancesScale& scale, const PxCookingParams& params )
+uint64_t hashMeshDesc( const PxTriangleMeshDesc& desc )
 {
-	return PhysxRef( new Physx( scale, params ) );
+	size_t indexSize = desc.flags & PxMeshFlag::e16_BIT_INDICES ? sizeof( PxU16 ) : sizeof( PxU32 );
+
+	// Material indices are per triangle when present
+	PxBoundedData materialIndices;
+	if ( desc.materialIndices.data != nullptr ) {
+		materialIndices.count	= desc.triangles.count;
+		materialIndices.data	= desc.materialIndices.data;
+		materialIndices.stride	= desc.materialIndices.stride;
+	}
+	return Hash()
+		.add( desc.points, sizeof( PxVec3 ) )
+		.add( desc.triangles, indexSize * 3 )
+		.add( materialIndices, sizeof( PxMaterialTableIndex ) )
+		.add( (uint16_t)desc.flags )
+		.getValue();
 }
+
+// Milliseconds from a monotonic, high-resolution clock
+double getMilliseconds()
+{
+#if defined( CINDER_MSW )
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &counter );
+	return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
 #else
-PhysxRef Physx::create( bool connectToPvd )
+	return chrono::duration<double, milli>( chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+void* alignedAlloc( size_t size )
+{
+#if defined( CINDER_MSW )
+	return _aligned_malloc( size, 16 );
+#else
+	void* ptr = nullptr;
+	return posix_memalign( &ptr, 16, size ) == 0 ? ptr : nullptr;
+#endif
+}
+
+void alignedFree( void* ptr )
 {
-	return create( PxTolerancesScale(), connectToPvd );
+#if defined( CINDER_MSW )
+	_aligned_free( ptr );
+#else
+	free( ptr );
+#endif
 }
 
-PhysxRef Physx::create( const PxTolerancesScale& scale, bool connectToPvd )
+PxCookingParams createCookingParams( const PxTolerancesScale& scale )
 {
 	PxCookingParams params( scale );
 	params.meshWeldTolerance	= 0.001f;
@@ -54,521 +327,4848 @@ PhysxRef Physx::create( const PxTolerancesScale& scale, bool connectToPvd )
 		PxMeshPreprocessingFlag::eWELD_VERTICES					| 
 		PxMeshPreprocessingFlag::eREMOVE_UNREFERENCED_VERTICES	| 
 		PxMeshPreprocessingFlag::eREMOVE_DUPLICATED_TRIANGLES );
-	return PhysxRef( new Physx( scale, params, connectToPvd ) );
+	return params;
 }
 
-PhysxRef Physx::create( const PxTolerancesScale& scale, const PxCookingParams& params, bool connectToPvd )
+// Writes a column-major rotation and translation, with each axis 
+// optionally scaled by the size of a bounding box
+void toMatrix( const PxTransform& t, const PxBounds3* b, float* m )
 {
-	return PhysxRef( new Physx( scale, params, connectToPvd ) );
+	const PxQuat& q	= t.q;
+	float x2		= q.x + q.x;
+	float y2		= q.y + q.y;
+	float z2		= q.z + q.z;
+	float xx		= q.x * x2;
+	float yy		= q.y * y2;
+	float zz		= q.z * z2;
+	float xy		= q.x * y2;
+	float xz		= q.x * z2;
+	float yz		= q.y * z2;
+	float wx		= q.w * x2;
+	float wy		= q.w * y2;
+	float wz		= q.w * z2;
+	PxVec3 s		= b == nullptr ? PxVec3( 1.0f ) : b->maximum - b->minimum;
+
+	m[ 0 ]	= ( 1.0f - ( yy + zz ) ) * s.x;
+	m[ 1 ]	= ( xy + wz ) * s.x;
+	m[ 2 ]	= ( xz - wy ) * s.x;
+	m[ 3 ]	= 0.0f;
+	m[ 4 ]	= ( xy - wz ) * s.y;
+	m[ 5 ]	= ( 1.0f - ( xx + zz ) ) * s.y;
+	m[ 6 ]	= ( yz + wx ) * s.y;
+	m[ 7 ]	= 0.0f;
+	m[ 8 ]	= ( xz + wy ) * s.z;
+	m[ 9 ]	= ( yz - wx ) * s.z;
+	m[ 10 ]	= ( 1.0f - ( xx + yy ) ) * s.z;
+	m[ 11 ]	= 0.0f;
+	m[ 12 ]	= t.p.x;
+	m[ 13 ]	= t.p.y;
+	m[ 14 ]	= t.p.z;
+	m[ 15 ]	= 1.0f;
 }
-#endif
 
-Physx::Physx( const PxTolerancesScale& scale, const PxCookingParams& params
-#if !defined( CINDER_COCOA_TOUCH )
-, bool connectToPvd
-#endif
-)
-: mCooking( nullptr ), mCpuDispatcher( nullptr ), mFoundation( nullptr ),
-mPhysics( nullptr ), mProfileZoneManager( nullptr )
-#if !defined( CINDER_COCOA_TOUCH )
-, mPvdConnection( nullptr )
-#endif
-#if PX_SUPPORT_GPU_PHYSX
-, mCudaContextManager( nullptr )
-#endif
+void toMatrices( const PxTransform* t, const PxBounds3* b, mat4* matrices, size_t count )
 {
-	mFoundation = PxCreateFoundation( PX_PHYSICS_VERSION, mAllocator, getErrorCallback() );
-	CI_ASSERT( mFoundation != nullptr );
-
-#if !defined( CINDER_COCOA_TOUCH )
-	if ( connectToPvd ) {
-		mProfileZoneManager = &PxProfileZoneManager::createProfileZoneManager( mFoundation );
-		CI_ASSERT( mProfileZoneManager != nullptr );
-	}
-#endif
+	size_t i = 0;
+#if defined( CINDER_PHYSX_SSE )
+	// Four transforms at a time. Quaternions are transposed so each 
+	// register holds one component of all four, the rotation terms are 
+	// built side by side, then each column is transposed back out.
+	const __m128 one	= _mm_set1_ps( 1.0f );
+	const __m128 zero	= _mm_setzero_ps();
+	for ( ; i + 4 <= count; i += 4, t += 4 ) {
+		__m128 x = _mm_loadu_ps( &t[ 0 ].q.x );
+		__m128 y = _mm_loadu_ps( &t[ 1 ].q.x );
+		__m128 z = _mm_loadu_ps( &t[ 2 ].q.x );
+		__m128 w = _mm_loadu_ps( &t[ 3 ].q.x );
+		_MM_TRANSPOSE4_PS( x, y, z, w );
 
-#if defined( CINDER_COCOA_TOUCH )
-	mPhysics = PxCreatePhysics( PX_PHYSICS_VERSION, *mFoundation, scale, false, mProfileZoneManager );
-#else
-	mPhysics = PxCreatePhysics( PX_PHYSICS_VERSION, *mFoundation, scale, connectToPvd, mProfileZoneManager );
-#endif
-	CI_ASSERT( mPhysics != nullptr );
-	CI_ASSERT( PxInitExtensions( *mPhysics ) );
+		__m128 x2 = _mm_add_ps( x, x );
+		__m128 y2 = _mm_add_ps( y, y );
+		__m128 z2 = _mm_add_ps( z, z );
+		__m128 xx = _mm_mul_ps( x, x2 );
+		__m128 yy = _mm_mul_ps( y, y2 );
+		__m128 zz = _mm_mul_ps( z, z2 );
+		__m128 xy = _mm_mul_ps( x, y2 );
+		__m128 xz = _mm_mul_ps( x, z2 );
+		__m128 yz = _mm_mul_ps( y, z2 );
+		__m128 wx = _mm_mul_ps( w, x2 );
+		__m128 wy = _mm_mul_ps( w, y2 );
+		__m128 wz = _mm_mul_ps( w, z2 );
 
-	mCooking = PxCreateCooking( PX_PHYSICS_VERSION, *mFoundation, params );
-	CI_ASSERT( mCooking != nullptr );
+		__m128 c[ 4 ][ 4 ] = {
+			{ _mm_sub_ps( one, _mm_add_ps( yy, zz ) ), _mm_add_ps( xy, wz ), _mm_sub_ps( xz, wy ), zero }, 
+			{ _mm_sub_ps( xy, wz ), _mm_sub_ps( one, _mm_add_ps( xx, zz ) ), _mm_add_ps( yz, wx ), zero }, 
+			{ _mm_add_ps( xz, wy ), _mm_sub_ps( yz, wx ), _mm_sub_ps( one, _mm_add_ps( xx, yy ) ), zero }, 
+			{ 
+				_mm_set_ps( t[ 3 ].p.x, t[ 2 ].p.x, t[ 1 ].p.x, t[ 0 ].p.x ), 
+				_mm_set_ps( t[ 3 ].p.y, t[ 2 ].p.y, t[ 1 ].p.y, t[ 0 ].p.y ), 
+				_mm_set_ps( t[ 3 ].p.z, t[ 2 ].p.z, t[ 1 ].p.z, t[ 0 ].p.z ), 
+				one
+			}
+		};
 
-	mCpuDispatcher = PxDefaultCpuDispatcherCreate( System::getNumCores() );
-	CI_ASSERT( mCpuDispatcher != nullptr );
+		if ( b != nullptr ) {
+			const PxBounds3* bb = b + i;
+			__m128 s[ 3 ] = {
+				_mm_set_ps( 
+					bb[ 3 ].maximum.x - bb[ 3 ].minimum.x, bb[ 2 ].maximum.x - bb[ 2 ].minimum.x, 
+					bb[ 1 ].maximum.x - bb[ 1 ].minimum.x, bb[ 0 ].maximum.x - bb[ 0 ].minimum.x ), 
+				_mm_set_ps( 
+					bb[ 3 ].maximum.y - bb[ 3 ].minimum.y, bb[ 2 ].maximum.y - bb[ 2 ].minimum.y, 
+					bb[ 1 ].maximum.y - bb[ 1 ].minimum.y, bb[ 0 ].maximum.y - bb[ 0 ].minimum.y ), 
+				_mm_set_ps( 
+					bb[ 3 ].maximum.z - bb[ 3 ].minimum.z, bb[ 2 ].maximum.z - bb[ 2 ].minimum.z, 
+					bb[ 1 ].maximum.z - bb[ 1 ].minimum.z, bb[ 0 ].maximum.z - bb[ 0 ].minimum.z )
+			};
+			for ( size_t j = 0; j < 3; ++j ) {
+				for ( size_t k = 0; k < 3; ++k ) {
+					c[ j ][ k ] = _mm_mul_ps( c[ j ][ k ], s[ j ] );
+				}
+			}
+		}
 
-#if PX_SUPPORT_GPU_PHYSX
-	PxCudaContextManagerDesc cudaContextManagerDesc;
-	mCudaContextManager = PxCreateCudaContextManager( *mFoundation, cudaContextManagerDesc, mProfileZoneManager );
-	if ( mCudaContextManager && !mCudaContextManager->contextIsValid() ) {
-		mCudaContextManager->release();
-		mCudaContextManager = nullptr;
+		float* m = &matrices[ i ][ 0 ][ 0 ];
+		for ( size_t j = 0; j < 4; ++j ) {
+			_MM_TRANSPOSE4_PS( c[ j ][ 0 ], c[ j ][ 1 ], c[ j ][ 2 ], c[ j ][ 3 ] );
+			for ( size_t k = 0; k < 4; ++k ) {
+				_mm_storeu_ps( m + k * 16 + j * 4, c[ j ][ k ] );
+			}
+		}
 	}
 #endif
-
-#if !defined( CINDER_COCOA_TOUCH )
-	if ( connectToPvd && mPhysics->getPvdConnectionManager() ) {
-		mPhysics->getPvdConnectionManager()->addHandler( *this );
+	for ( ; i < count; ++i, ++t ) {
+		toMatrix( *t, b == nullptr ? nullptr : b + i, &matrices[ i ][ 0 ][ 0 ] );
 	}
-#endif
 }
 
-Physx::~Physx()
+// Appends cooked data straight into a vector
+class VectorOutputStream : public PxOutputStream
 {
-#if !defined( CINDER_COCOA_TOUCH )
-	pvdDisconnect();
-#endif
-	for ( auto& iter : mActors ) {
-		iter.second->release();
+public:
+	VectorOutputStream( vector<PxU8>& data )
+	: mData( data )
+	{
 	}
-	mActors.clear();
 
-	for ( auto& iter : mScenes ) {
-		iter.second->release();
+	PxU32 write( const void* src, PxU32 count )
+	{
+		const PxU8* bytes = (const PxU8*)src;
+		mData.insert( mData.end(), bytes, bytes + count );
+		return count;
 	}
-	mScenes.clear();
+private:
+	vector<PxU8>& mData;
+};
 
-	if ( mCooking != nullptr ) {
-		mCooking->release();
-		mCooking = nullptr;
-	}
-	if ( mCpuDispatcher != nullptr ) {
-		mCpuDispatcher->release();
-		mCpuDispatcher = nullptr;
-	}
-#if PX_SUPPORT_GPU_PHYSX
-	if ( mCudaContextManager != nullptr ) {
-		mCudaContextManager->release();
-		mCudaContextManager = nullptr;
-	}
-#endif
-	if ( mPhysics != nullptr ) {
-		mPhysics->release();
-		mPhysics = nullptr;
-	}
-	if ( mFoundation != nullptr ) {
-		mFoundation->release();
-		mFoundation = nullptr;
-	}
+PxConvexMesh* createMesh( PxPhysics* physics, PxInputData& input, PxConvexMesh* )
+{
+	return physics->createConvexMesh( input );
 }
 
-mat3 Physx::from( const PxMat33& m )
+PxTriangleMesh* createMesh( PxPhysics* physics, PxInputData& input, PxTriangleMesh* )
 {
-	return mat3(
-		m.column0.x, m.column0.y, m.column0.z, 
-		m.column1.x, m.column1.y, m.column1.z, 
-		m.column2.x, m.column2.y, m.column2.z
-		);
+	return physics->createTriangleMesh( input );
 }
 
-mat4 Physx::from( const PxMat44& m )
+string toHex( uint64_t value )
 {
-	return mat4(
-		m.column0.x, m.column0.y, m.column0.z, m.column0.w, 
-		m.column1.x, m.column1.y, m.column1.z, m.column1.w,
-		m.column2.x, m.column2.y, m.column2.z, m.column2.w,
-		m.column3.x, m.column3.y, m.column3.z, m.column3.w
-		);
+	ostringstream stream;
+	stream << hex << setfill( '0' ) << setw( 16 ) << value;
+	return stream.str();
 }
 
-mat4 Physx::from( const PxTransform& t )
-{
-	return from( t.q, t.p );
 }
 
-mat4 Physx::from( const PxQuat& q, const PxVec3& v )
+// Fixed set of threads for work that would otherwise stall the 
+// simulation's dispatcher, like mesh cooking
+class Physx::ThreadPool
+{
+public:
+	ThreadPool( size_t numThreads )
+	: mRunning( true )
+	{
+		for ( size_t i = 0; i < numThreads; ++i ) {
+			mThreads.push_back( thread( [ this ]()
+			{
+				while ( true ) {
+					function<void()> job;
+					{
+						unique_lock<mutex> lock( mMutex );
+						mCondition.wait( lock, [ this ]() -> bool
+						{
+							return !mRunning || !mJobs.empty();
+						} );
+						if ( !mRunning && mJobs.empty() ) {
+							return;
+						}
+						job = mJobs.front();
+						mJobs.pop_front();
+					}
+					job();
+				}
+			} ) );
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			lock_guard<mutex> lock( mMutex );
+			mRunning = false;
+		}
+		mCondition.notify_all();
+		for ( thread& t : mThreads ) {
+			t.join();
+		}
+	}
+
+	void submit( const function<void()>& job )
+	{
+		{
+			lock_guard<mutex> lock( mMutex );
+			mJobs.push_back( job );
+		}
+		mCondition.notify_one();
+	}
+private:
+	condition_variable				mCondition;
+	deque<function<void()>>			mJobs;
+	mutex							mMutex;
+	bool							mRunning;
+	vector<thread>					mThreads;
+};
+
+template<typename T>
+struct Physx::MeshFuture<T>::State
+{
+	State( PxPhysics* physics, const shared_ptr<atomic<bool>>& alive, const shared_future<vector<PxU8>>& future )
+	: mAlive( alive ), mCreated( false ), mFuture( future ), mMesh( nullptr ), mPhysics( physics )
+	{
+	}
+
+	shared_ptr<atomic<bool>>		mAlive;
+	bool							mCreated;
+	shared_future<vector<PxU8>>		mFuture;
+	T*								mMesh;
+	mutex							mMutex;
+	PxPhysics*						mPhysics;
+};
+
+template<typename T>
+Physx::MeshFuture<T>::MeshFuture()
 {
-	return from( PxMat33( q ), v );
 }
 
-mat4 Physx::from( const PxMat33& m, const PxVec3& v )
+template<typename T>
+Physx::MeshFuture<T>::MeshFuture( const shared_ptr<State>& state )
+: mState( state )
 {
-	return mat4(
-		m.column0.x, m.column0.y, m.column0.z, 0.0f, 
-		m.column1.x, m.column1.y, m.column1.z, 0.0f, 
-		m.column2.x, m.column2.y, m.column2.z, 0.0f, 
-		v.x, v.y, v.z, 1.0f
-		);
 }
 
-quat Physx::from( const PxQuat& q )
+template<typename T>
+T* Physx::MeshFuture<T>::get()
 {
-	return quat( q.w, q.x, q.y, q.z );
+	if ( !mState ) {
+		return nullptr;
+	}
+
+	// Copies share state, so the mesh is only ever created once. The 
+	// mesh goes away with the PxPhysics that owns it.
+	lock_guard<mutex> lock( mState->mMutex );
+	if ( !*mState->mAlive ) {
+		return nullptr;
+	}
+	if ( !mState->mCreated ) {
+		const vector<PxU8>& data = mState->mFuture.get();
+		if ( !data.empty() ) {
+			PxDefaultMemoryInputData input( (PxU8*)&data[ 0 ], (PxU32)data.size() );
+			mState->mMesh = createMesh( mState->mPhysics, input, (T*)nullptr );
+		}
+		mState->mFuture		= shared_future<vector<PxU8>>();
+		mState->mCreated	= true;
+	}
+	return mState->mMesh;
 }
 
-vec2 Physx::from( const PxVec2& v )
+template<typename T>
+bool Physx::MeshFuture<T>::isReady() const
 {
-	return vec2( v.x, v.y );
+	if ( !mState ) {
+		return false;
+	}
+	lock_guard<mutex> lock( mState->mMutex );
+	return mState->mCreated || mState->mFuture.wait_for( chrono::seconds( 0 ) ) == future_status::ready;
 }
 
-vec3 Physx::from( const PxVec3& v )
+template<typename T>
+bool Physx::MeshFuture<T>::isValid() const
 {
-	return vec3( v.x, v.y, v.z );
+	return mState != nullptr;
 }
 
-vec4 Physx::from( const PxVec4& v )
+template class Physx::MeshFuture<PxConvexMesh>;
+template class Physx::MeshFuture<PxTriangleMesh>;
+
+Physx::InstanceBuckets::InstanceBuckets()
+: mInterpolated( false ), mNumActorChanges( 0 ), mSource( nullptr )
 {
-	return vec4( v.x, v.y, v.z, v.w );
 }
 
-AxisAlignedBox Physx::from( const PxBounds3& b )
+void Physx::InstanceBuckets::add( const PxRigidActor& actor )
 {
-	return AxisAlignedBox( from( b.minimum ), from( b.maximum ) );
+	add( actor, actor.getGlobalPose() );
 }
 
-PxMat33 Physx::to( const mat3& m )
+void Physx::InstanceBuckets::add( const PxRigidActor& actor, const PxTransform& pose )
 {
-	return PxMat33( 
-		to( vec3( m[ 0 ] ) ), 
-		to( vec3( m[ 1 ] ) ), 
-		to( vec3( m[ 2 ] ) ) 
-		);
+	uintptr_t id				= (uintptr_t)actor.userData;
+	vector<Location>& locations	= mLocations[ (uint32_t)id ];
+
+	PxShape* shapes[ 8 ];
+	PxU32 numShapes = actor.getNbShapes();
+	for ( PxU32 start = 0; start < numShapes; start += 8 ) {
+		PxU32 count = actor.getShapes( shapes, 8, start );
+		for ( PxU32 i = 0; i < count; ++i ) {
+			const PxGeometryHolder geometry = shapes[ i ]->getGeometry();
+			if ( geometry.getType() < 0 || geometry.getType() >= PxGeometryType::eGEOMETRY_COUNT ) {
+				continue;
+			}
+
+			PxVec3 scale( 1.0f );
+			switch ( geometry.getType() ) {
+			case PxGeometryType::eBOX:
+				scale = geometry.box().halfExtents * 2.0f;
+				break;
+			case PxGeometryType::eCAPSULE:
+				scale = PxVec3( 
+					( geometry.capsule().halfHeight + geometry.capsule().radius ) * 2.0f, 
+					geometry.capsule().radius * 2.0f, 
+					geometry.capsule().radius * 2.0f );
+				break;
+			case PxGeometryType::eCONVEXMESH:
+				scale = geometry.convexMesh().scale.scale;
+				break;
+			case PxGeometryType::eHEIGHTFIELD:
+				scale = PxVec3( 
+					geometry.heightField().rowScale, 
+					geometry.heightField().heightScale, 
+					geometry.heightField().columnScale );
+				break;
+			case PxGeometryType::eSPHERE:
+				scale = PxVec3( geometry.sphere().radius * 2.0f );
+				break;
+			case PxGeometryType::eTRIANGLEMESH:
+				scale = geometry.triangleMesh().scale.scale;
+				break;
+			default:
+				break;
+			}
+
+			Bucket& bucket = mBuckets[ geometry.getType() ];
+			locations.push_back( Location( geometry.getType(), bucket.mPoses.size() ) );
+			bucket.mIds.push_back( (uint32_t)id );
+			bucket.mLocalPoses.push_back( shapes[ i ]->getLocalPose() );
+			bucket.mPoses.push_back( pose * shapes[ i ]->getLocalPose() );
+			bucket.mScales.push_back( scale );
+		}
+	}
 }
 
-PxMat44 Physx::to( const mat4& m )
+void Physx::InstanceBuckets::clear()
 {
-	return PxMat44(
-		to( vec4( m[ 0 ] ) ),
-		to( vec4( m[ 1 ] ) ),
-		to( vec4( m[ 2 ] ) ), 
-		to( vec4( m[ 3 ] ) )
-		);
+	for ( Bucket& bucket : mBuckets ) {
+		bucket.mIds.clear();
+		bucket.mLocalPoses.clear();
+		bucket.mPoses.clear();
+		bucket.mScales.clear();
+	}
+	mLocations.clear();
+	mMovingIds.clear();
+	mInterpolated		= false;
+	mNumActorChanges	= 0;
+	mSource				= nullptr;
 }
 
-PxQuat Physx::to( const quat& q )
+bool Physx::InstanceBuckets::contains( uint32_t id ) const
 {
-	return PxQuat( q.x, q.y, q.z, q.w );
+	return mLocations.find( id ) != mLocations.end();
 }
 
-PxVec2 Physx::to( const vec2& v )
+void Physx::InstanceBuckets::erase( uint32_t id )
 {
-	return PxVec2( v.x, v.y );
+	map<uint32_t, vector<Location>>::iterator iter = mLocations.find( id );
+	if ( iter == mLocations.end() ) {
+		return;
+	}
+	vector<Location> locations = iter->second;
+	mLocations.erase( iter );
+
+	// Instances are swapped with the back of their bucket. Going in 
+	// reverse means the back is never another instance of this actor.
+	for ( vector<Location>::reverse_iterator location = locations.rbegin(); location != locations.rend(); ++location ) {
+		Bucket& bucket	= mBuckets[ location->first ];
+		size_t index	= location->second;
+		size_t last		= bucket.mPoses.size() - 1;
+		if ( index != last ) {
+			bucket.mIds[ index ]		= bucket.mIds[ last ];
+			bucket.mLocalPoses[ index ]	= bucket.mLocalPoses[ last ];
+			bucket.mPoses[ index ]		= bucket.mPoses[ last ];
+			bucket.mScales[ index ]		= bucket.mScales[ last ];
+			for ( Location& moved : mLocations[ bucket.mIds[ index ] ] ) {
+				if ( moved.first == location->first && moved.second == last ) {
+					moved.second = index;
+					break;
+				}
+			}
+		}
+		bucket.mIds.pop_back();
+		bucket.mLocalPoses.pop_back();
+		bucket.mPoses.pop_back();
+		bucket.mScales.pop_back();
+	}
 }
 
-PxVec3 Physx::to( const vec3& v )
+void Physx::InstanceBuckets::setPose( uint32_t id, const PxTransform& pose )
 {
-	return PxVec3( v.x, v.y, v.z );
+	map<uint32_t, vector<Location>>::iterator iter = mLocations.find( id );
+	if ( iter != mLocations.end() ) {
+		for ( const Location& location : iter->second ) {
+			Bucket& bucket = mBuckets[ location.first ];
+			bucket.mPoses[ location.second ] = pose * bucket.mLocalPoses[ location.second ];
+		}
+	}
 }
 
-PxVec4 Physx::to( const vec4& v )
+size_t Physx::InstanceBuckets::getNumInstances( PxGeometryType::Enum type ) const
+{
+	if ( type < 0 || type >= PxGeometryType::eGEOMETRY_COUNT ) {
+		return 0;
+	}
+	return mBuckets[ type ].mPoses.size();
+}
+
+size_t Physx::InstanceBuckets::write( PxGeometryType::Enum type, void* data, size_t capacity, size_t stride ) const
+{
+	CI_ASSERT( stride >= sizeof( Instance ) );
+	if ( data == nullptr ) {
+		return 0;
+	}
+	size_t count = min( getNumInstances( type ), capacity );
+	if ( count == 0 ) {
+		return 0;
+	}
+
+	// Poses are converted in one batch, then scaled into place. The 
+	// normal matrix is the rotation alone. Scale is left out so it 
+	// doesn't need to be inverted per instance.
+	const Bucket& bucket = mBuckets[ type ];
+	bucket.mMatrices.resize( count );
+	toMatrices( bucket.mPoses.data(), nullptr, bucket.mMatrices.data(), count );
+
+	uint8_t* bytes = (uint8_t*)data;
+	for ( size_t i = 0; i < count; ++i, bytes += stride ) {
+		const float* r	= &bucket.mMatrices[ i ][ 0 ][ 0 ];
+		float* m		= (float*)bytes;
+		float* n		= m + 16;
+		for ( size_t j = 0; j < 3; ++j ) {
+			const PxReal s	= bucket.mScales[ i ][ (PxU32)j ];
+			const float* c	= r + j * 4;
+			n[ j * 3 + 0 ]	= c[ 0 ];
+			n[ j * 3 + 1 ]	= c[ 1 ];
+			n[ j * 3 + 2 ]	= c[ 2 ];
+			m[ j * 4 + 0 ]	= c[ 0 ] * s;
+			m[ j * 4 + 1 ]	= c[ 1 ] * s;
+			m[ j * 4 + 2 ]	= c[ 2 ] * s;
+			m[ j * 4 + 3 ]	= 0.0f;
+		}
+		m[ 12 ]	= r[ 12 ];
+		m[ 13 ]	= r[ 13 ];
+		m[ 14 ]	= r[ 14 ];
+		m[ 15 ]	= 1.0f;
+	}
+	return count;
+}
+
+PxFilterFlags FilterShader(
+	PxFilterObjectAttributes attributes0, PxFilterData filterData0,
+	PxFilterObjectAttributes attributes1, PxFilterData filterData1,
+	PxPairFlags& pairFlags, const void* constantBlock, PxU32 constantBlockSize )
+{
+	PxU32 groups0	= filterData0.word0 == 0 ? 0xffffffff : filterData0.word0;
+	PxU32 groups1	= filterData1.word0 == 0 ? 0xffffffff : filterData1.word0;
+	PxU32 mask0		= filterData0.word1 == 0 ? 0xffffffff : filterData0.word1;
+	PxU32 mask1		= filterData1.word1 == 0 ? 0xffffffff : filterData1.word1;
+	if ( ( groups0 & mask1 ) == 0 || ( groups1 & mask0 ) == 0 ) {
+		return PxFilterFlag::eKILL;
+	}
+
+	if ( PxFilterObjectIsTrigger( attributes0 ) || PxFilterObjectIsTrigger( attributes1 ) ) {
+		pairFlags = PxPairFlag::eTRIGGER_DEFAULT;
+		return PxFilterFlag::eDEFAULT;
+	}
+
+	pairFlags = PxPairFlag::eCONTACT_DEFAULT;
+	if ( ( filterData0.word2 & groups1 ) != 0 || ( filterData1.word2 & groups0 ) != 0 ) {
+		PxU32 notifyFlags = PxPairFlag::eNOTIFY_TOUCH_FOUND;
+		if ( constantBlock != nullptr && constantBlockSize >= sizeof( FilterShaderData ) ) {
+			notifyFlags = static_cast<const FilterShaderData*>( constantBlock )->mNotifyFlags;
+		}
+
+		// Only notification bits are taken, so the data can't switch 
+		// off contact solving or turn on contact modification
+		const PxPairFlags notifyMask = 
+			PxPairFlag::eNOTIFY_TOUCH_FOUND | PxPairFlag::eNOTIFY_TOUCH_PERSISTS | PxPairFlag::eNOTIFY_TOUCH_LOST | 
+			PxPairFlag::eNOTIFY_THRESHOLD_FORCE_FOUND | PxPairFlag::eNOTIFY_THRESHOLD_FORCE_PERSISTS | 
+			PxPairFlag::eNOTIFY_THRESHOLD_FORCE_LOST | PxPairFlag::eNOTIFY_CONTACT_POINTS;
+		pairFlags |= PxPairFlags( (PxU16)notifyFlags ) & notifyMask;
+	}
+	return PxFilterFlag::eDEFAULT;
+}
+
+FilterShaderData::FilterShaderData()
+: mNotifyFlags( PxPairFlag::eNOTIFY_TOUCH_FOUND )
+{
+}
+
+namespace {
+
+// Single-producer, single-consumer ring. PhysX fills it from whichever 
+// thread fetches results and the app drains it, without locks. Storage 
+// is allocated once; a full ring drops new events.
+template<typename T>
+class EventRing
+{
+public:
+	EventRing( size_t capacity )
+	: mEvents( max<size_t>( capacity, 1 ) ), mHead( 0 ), mTail( 0 )
+	{
+	}
+
+	void drain( vector<T>& events )
+	{
+		size_t head = mHead.load( memory_order_relaxed );
+		size_t tail = mTail.load( memory_order_acquire );
+		events.reserve( events.size() + ( tail - head ) );
+		for ( ; head != tail; ++head ) {
+			events.push_back( mEvents[ head % mEvents.size() ] );
+		}
+		mHead.store( head, memory_order_release );
+	}
+
+	bool push( const T& e )
+	{
+		size_t tail = mTail.load( memory_order_relaxed );
+		if ( tail - mHead.load( memory_order_acquire ) >= mEvents.size() ) {
+			return false;
+		}
+		mEvents[ tail % mEvents.size() ] = e;
+		mTail.store( tail + 1, memory_order_release );
+		return true;
+	}
+private:
+	vector<T>		mEvents;
+	atomic<size_t>	mHead;
+	atomic<size_t>	mTail;
+};
+
+// Bounded multi-producer, multi-consumer ring. Each cell carries a 
+// sequence number that tells pushers and poppers whether it is theirs, 
+// so neither side takes a lock. Capacity is rounded up to a power of two.
+template<typename T>
+class ConcurrentRing
+{
+public:
+	ConcurrentRing( size_t capacity )
+	: mCells( roundUp( capacity ) ), mHead( 0 ), mMask( mCells.size() - 1 ), mTail( 0 )
+	{
+		for ( size_t i = 0; i < mCells.size(); ++i ) {
+			mCells[ i ].mSequence.store( i, memory_order_relaxed );
+		}
+	}
+
+	bool pop( T& value )
+	{
+		size_t head = mHead.load( memory_order_relaxed );
+		while ( true ) {
+			Cell& cell		= mCells[ head & mMask ];
+			size_t sequence	= cell.mSequence.load( memory_order_acquire );
+			intptr_t diff	= (intptr_t)sequence - (intptr_t)( head + 1 );
+			if ( diff == 0 ) {
+				if ( mHead.compare_exchange_weak( head, head + 1, memory_order_relaxed ) ) {
+					value = cell.mValue;
+					cell.mSequence.store( head + mMask + 1, memory_order_release );
+					return true;
+				}
+			} else if ( diff < 0 ) {
+				return false;
+			} else {
+				head = mHead.load( memory_order_relaxed );
+			}
+		}
+	}
+
+	bool push( const T& value )
+	{
+		size_t tail = mTail.load( memory_order_relaxed );
+		while ( true ) {
+			Cell& cell		= mCells[ tail & mMask ];
+			size_t sequence	= cell.mSequence.load( memory_order_acquire );
+			intptr_t diff	= (intptr_t)sequence - (intptr_t)tail;
+			if ( diff == 0 ) {
+				if ( mTail.compare_exchange_weak( tail, tail + 1, memory_order_relaxed ) ) {
+					cell.mValue = value;
+					cell.mSequence.store( tail + 1, memory_order_release );
+					return true;
+				}
+			} else if ( diff < 0 ) {
+				return false;
+			} else {
+				tail = mTail.load( memory_order_relaxed );
+			}
+		}
+	}
+private:
+	static size_t roundUp( size_t capacity )
+	{
+		size_t size = 1;
+		while ( size < capacity ) {
+			size <<= 1;
+		}
+		return size;
+	}
+
+	struct Cell
+	{
+		atomic<size_t>	mSequence;
+		T				mValue;
+	};
+
+	// Pushers and poppers each get their own cache line
+	vector<Cell>		mCells;
+	CINDER_PHYSX_CACHE_ALIGNED atomic<size_t>	mHead;
+	size_t				mMask;
+	CINDER_PHYSX_CACHE_ALIGNED atomic<size_t>	mTail;
+};
+
+enum CommandType
+{
+	COMMAND_ADD_ACTOR, 
+	COMMAND_ERASE_ACTOR, 
+	COMMAND_SET_ANGULAR_VELOCITY, 
+	COMMAND_SET_GLOBAL_POSE, 
+	COMMAND_SET_KINEMATIC_TARGET, 
+	COMMAND_SET_LINEAR_VELOCITY
+};
+
+struct Command
+{
+	Command()
+	: mActor( nullptr ), mId( Physx::kInvalidId ), mPose( PxIdentity ), mSceneId( 0 ), 
+	mType( COMMAND_ERASE_ACTOR ), mVelocity( 0.0f )
+	{
+	}
+
+	PxActor*			mActor;
+	uint32_t			mId;
+	PxTransform			mPose;
+	uint32_t			mSceneId;
+	CommandType			mType;
+	vec3				mVelocity;
+};
+
+}
+
+// Commands from worker threads plus the IDs handed out for queued 
+// actors. mNumReservedIds counts IDs that are in mIds, held by a 
+// producer or waiting in mCommands. It never exceeds mCapacity, so a 
+// producer returning an unused ID always finds room for it.
+class Physx::CommandQueue
+{
+public:
+	CommandQueue( size_t capacity )
+	: mCapacity( capacity ), mCommands( capacity ), mIds( capacity ), mNumReservedIds( 0 )
+	{
+	}
+
+	size_t						mCapacity;
+	ConcurrentRing<Command>		mCommands;
+	ConcurrentRing<uint32_t>	mIds;
+	atomic<size_t>				mNumReservedIds;
+};
+
+class Physx::EventCallback : public PxSimulationEventCallback
+{
+public:
+	EventCallback( uint32_t sceneId, size_t capacity )
+	: mContacts( capacity ), mNumDropped( 0 ), mSleeps( capacity ), mTriggers( capacity ), 
+	mSceneId( sceneId )
+	{
+	}
+
+	void onConstraintBreak( PxConstraintInfo*, PxU32 )
+	{
+	}
+
+	void onContact( const PxContactPairHeader& header, const PxContactPair* pairs, PxU32 count )
+	{
+		ContactEvent e;
+		e.mActor0	= header.flags & PxContactPairHeaderFlag::eDELETED_ACTOR_0 ? kInvalidId : getId( header.actors[ 0 ] );
+		e.mActor1	= header.flags & PxContactPairHeaderFlag::eDELETED_ACTOR_1 ? kInvalidId : getId( header.actors[ 1 ] );
+		e.mSceneId	= mSceneId;
+		for ( PxU32 i = 0; i < count; ++i ) {
+			const PxContactPair& pair = pairs[ i ];
+
+			// Points are only available when the pair asked for them
+			PxContactPairPoint points[ 16 ];
+			PxU32 numPoints = pair.contactCount > 0 ? pair.extractContacts( points, 16 ) : 0;
+			e.mEvents		= pair.events;
+			e.mImpulse		= PxVec3( 0.0f );
+			e.mNormal		= numPoints > 0 ? points[ 0 ].normal : PxVec3( 0.0f );
+			e.mNumPoints	= numPoints;
+			e.mPoint		= numPoints > 0 ? points[ 0 ].position : PxVec3( 0.0f );
+			for ( PxU32 j = 0; j < numPoints; ++j ) {
+				e.mImpulse += points[ j ].impulse;
+			}
+			record( mContacts, e );
+		}
+	}
+
+	void onSleep( PxActor** actors, PxU32 count )
+	{
+		recordSleep( actors, count, false );
+	}
+
+	void onTrigger( PxTriggerPair* pairs, PxU32 count )
+	{
+		TriggerEvent e;
+		e.mSceneId = mSceneId;
+		for ( PxU32 i = 0; i < count; ++i ) {
+			const PxTriggerPair& pair = pairs[ i ];
+			e.mOtherActor	= pair.flags & PxTriggerPairFlag::eDELETED_SHAPE_OTHER ? kInvalidId : getId( pair.otherActor );
+			e.mStatus		= pair.status;
+			e.mTriggerActor	= pair.flags & PxTriggerPairFlag::eDELETED_SHAPE_TRIGGER ? kInvalidId : getId( pair.triggerActor );
+			record( mTriggers, e );
+		}
+	}
+
+	void onWake( PxActor** actors, PxU32 count )
+	{
+		recordSleep( actors, count, true );
+	}
+
+	EventRing<ContactEvent>	mContacts;
+	atomic<size_t>			mNumDropped;
+	EventRing<SleepEvent>	mSleeps;
+	EventRing<TriggerEvent>	mTriggers;
+private:
+	static uint32_t getId( const PxActor* actor )
+	{
+		return actor == nullptr ? kInvalidId : (uint32_t)(uintptr_t)actor->userData;
+	}
+
+	template<typename T>
+	void record( EventRing<T>& ring, const T& e )
+	{
+		if ( !ring.push( e ) ) {
+			++mNumDropped;
+		}
+	}
+
+	void recordSleep( PxActor** actors, PxU32 count, bool awake )
+	{
+		SleepEvent e;
+		e.mAwake	= awake;
+		e.mSceneId	= mSceneId;
+		for ( PxU32 i = 0; i < count; ++i ) {
+			e.mActor = getId( actors[ i ] );
+			record( mSleeps, e );
+		}
+	}
+
+	uint32_t				mSceneId;
+};
+
+// Owns a PxBatchQuery and the result memory it writes into. One per 
+// worker so chunks can execute concurrently.
+struct Physx::BatchQuery
+{
+	BatchQuery( PxScene* scene )
+	: mOverlapResults( kQueryChunkSize ), mQuery( nullptr ), mRaycastResults( kQueryChunkSize ), 
+	mSweepResults( kQueryChunkSize )
+	{
+		PxBatchQueryDesc desc( (PxU32)kQueryChunkSize, (PxU32)kQueryChunkSize, (PxU32)kQueryChunkSize );
+		desc.queryMemory.userOverlapResultBuffer	= &mOverlapResults[ 0 ];
+		desc.queryMemory.userOverlapTouchBuffer		= nullptr;
+		desc.queryMemory.overlapTouchBufferSize		= 0;
+		desc.queryMemory.userRaycastResultBuffer	= &mRaycastResults[ 0 ];
+		desc.queryMemory.userRaycastTouchBuffer		= nullptr;
+		desc.queryMemory.raycastTouchBufferSize		= 0;
+		desc.queryMemory.userSweepResultBuffer		= &mSweepResults[ 0 ];
+		desc.queryMemory.userSweepTouchBuffer		= nullptr;
+		desc.queryMemory.sweepTouchBufferSize		= 0;
+		mQuery = scene->createBatchQuery( desc );
+		CI_ASSERT( mQuery != nullptr );
+	}
+
+	~BatchQuery()
+	{
+		if ( mQuery != nullptr ) {
+			mQuery->release();
+		}
+	}
+
+	vector<PxOverlapQueryResult>	mOverlapResults;
+	PxBatchQuery*					mQuery;
+	vector<PxRaycastQueryResult>	mRaycastResults;
+	vector<PxSweepQueryResult>		mSweepResults;
+private:
+	BatchQuery( const BatchQuery& );
+	BatchQuery& operator=( const BatchQuery& );
+};
+
+// Keeps a loaded snapshot's memory alive. Deserialized objects 
+// point into the mapping, so it must outlive the SDK objects.
+struct Physx::Snapshot
+{
+	Snapshot( const fs::path& path )
+	: mFile( path, true )
+	{
+	}
+
+	MappedFile	mFile;
+private:
+	Snapshot( const Snapshot& );
+	Snapshot& operator=( const Snapshot& );
+};
+
+namespace {
+
+// One byte per recorded call, followed by its fixed-size arguments. 
+// Materials and meshes are defined once, the first time an actor 
+// uses them, and are referred to by definition order after that.
+enum RecordOpcode
+{
+	RECORD_ADD_ACTOR, 
+	RECORD_ADD_FORCE, 
+	RECORD_ADD_TORQUE, 
+	RECORD_CLEAR_ACTORS, 
+	RECORD_CONVEX_MESH, 
+	RECORD_CREATE_SCENE, 
+	RECORD_DISABLE_FIXED_TIMESTEP, 
+	RECORD_ENABLE_FIXED_TIMESTEP, 
+	RECORD_ERASE_ACTOR, 
+	RECORD_ERASE_SCENE, 
+	RECORD_FILTER_DATA, 
+	RECORD_FILTER_SHADER_DATA, 
+	RECORD_MATERIAL, 
+	RECORD_SCENE_ENABLED, 
+	RECORD_SCENE_PRIORITY, 
+	RECORD_SET_ANGULAR_VELOCITY, 
+	RECORD_SET_GLOBAL_POSE, 
+	RECORD_SET_KINEMATIC_TARGET, 
+	RECORD_SET_LINEAR_VELOCITY, 
+	RECORD_TRIANGLE_MESH, 
+	RECORD_UPDATE
+};
+
+}
+
+// Values are written in native byte order, so recordings are only 
+// portable between machines of the same endianness
+class Physx::Recorder
+{
+public:
+	Recorder( const fs::path& path )
+	: mFile( path.string().c_str(), ios::binary | ios::trunc )
+	{
+		write( kRecordMagic );
+		write( kRecordVersion );
+	}
+
+	bool isValid() const
+	{
+		return mFile.good();
+	}
+
+	template<typename T>
+	void write( const T& value )
+	{
+		mFile.write( (const char*)&value, sizeof( T ) );
+	}
+
+	void writeOpcode( RecordOpcode opcode )
+	{
+		write( (uint8_t)opcode );
+	}
+
+	void writeActor( uint32_t sceneId, uint32_t id, PxActor& actor )
+	{
+		if ( actor.getType() != PxActorType::eRIGID_DYNAMIC && 
+			 actor.getType() != PxActorType::eRIGID_STATIC ) {
+			CI_LOG_W( "Only rigid actors are recorded" );
+			return;
+		}
+		PxRigidActor& rigidActor = static_cast<PxRigidActor&>( actor );
+
+		// Define materials and meshes ahead of the actor
+		vector<PxShape*> shapes( rigidActor.getNbShapes() );
+		if ( !shapes.empty() ) {
+			rigidActor.getShapes( &shapes[ 0 ], (PxU32)shapes.size() );
+		}
+		vector<vector<uint32_t>> materials( shapes.size() );
+		vector<uint32_t> meshes( shapes.size(), kInvalidId );
+		for ( size_t i = 0; i < shapes.size(); ++i ) {
+			vector<PxMaterial*> shapeMaterials( shapes[ i ]->getNbMaterials() );
+			if ( !shapeMaterials.empty() ) {
+				shapes[ i ]->getMaterials( &shapeMaterials[ 0 ], (PxU32)shapeMaterials.size() );
+			}
+			for ( PxMaterial* material : shapeMaterials ) {
+				materials[ i ].push_back( getMaterialIndex( material ) );
+			}
+
+			PxGeometryHolder geometry = shapes[ i ]->getGeometry();
+			if ( geometry.getType() == PxGeometryType::eCONVEXMESH ) {
+				meshes[ i ] = getMeshIndex( geometry.convexMesh().convexMesh );
+			} else if ( geometry.getType() == PxGeometryType::eTRIANGLEMESH ) {
+				meshes[ i ] = getMeshIndex( geometry.triangleMesh().triangleMesh );
+			}
+		}
+
+		writeOpcode( RECORD_ADD_ACTOR );
+		write( sceneId );
+		write( id );
+		write( (uint8_t)actor.getType() );
+		write( rigidActor.getGlobalPose() );
+		write( actor.getActorFlags() );
+		write( actor.getDominanceGroup() );
+		if ( actor.getType() == PxActorType::eRIGID_DYNAMIC ) {
+			PxRigidDynamic& body = static_cast<PxRigidDynamic&>( actor );
+			PxU32 positionIterations	= 0;
+			PxU32 velocityIterations	= 0;
+			body.getSolverIterationCounts( positionIterations, velocityIterations );
+			write( body.getMass() );
+			write( body.getMassSpaceInertiaTensor() );
+			write( body.getCMassLocalPose() );
+			write( body.getLinearDamping() );
+			write( body.getAngularDamping() );
+			write( body.getMaxAngularVelocity() );
+			write( body.getLinearVelocity() );
+			write( body.getAngularVelocity() );
+			write( body.getRigidBodyFlags() );
+			write( positionIterations );
+			write( velocityIterations );
+			write( body.getSleepThreshold() );
+			write( (uint8_t)( body.getScene() != nullptr && body.isSleeping() ? 1 : 0 ) );
+		}
+
+		write( (uint32_t)shapes.size() );
+		for ( size_t i = 0; i < shapes.size(); ++i ) {
+			writeGeometry( shapes[ i ]->getGeometry(), meshes[ i ] );
+			write( shapes[ i ]->getLocalPose() );
+			write( shapes[ i ]->getFlags() );
+			write( shapes[ i ]->getSimulationFilterData() );
+			write( shapes[ i ]->getQueryFilterData() );
+			write( shapes[ i ]->getContactOffset() );
+			write( shapes[ i ]->getRestOffset() );
+			write( (uint16_t)materials[ i ].size() );
+			for ( uint32_t index : materials[ i ] ) {
+				write( index );
+			}
+		}
+	}
+
+	void writeScene( uint32_t id, const PxScene& scene )
+	{
+		vector<PxBroadPhaseRegionInfo> regions( scene.getNbBroadPhaseRegions() );
+		if ( !regions.empty() ) {
+			scene.getBroadPhaseRegions( &regions[ 0 ], (PxU32)regions.size() );
+		}
+
+		writeOpcode( RECORD_CREATE_SCENE );
+		write( id );
+		write( (uint8_t)scene.getBroadPhaseType() );
+		write( scene.getGravity() );
+		write( scene.getFlags() );
+		write( (uint8_t)scene.getFrictionType() );
+		write( (uint32_t)regions.size() );
+		for ( const PxBroadPhaseRegionInfo& info : regions ) {
+			write( info.region.bounds );
+		}
+	}
+private:
+	uint32_t getMaterialIndex( PxMaterial* material )
+	{
+		map<const PxBase*, uint32_t>::iterator iter = mMaterials.find( material );
+		if ( iter != mMaterials.end() ) {
+			return iter->second;
+		}
+		uint32_t index			= (uint32_t)mMaterials.size();
+		mMaterials[ material ]	= index;
+
+		writeOpcode( RECORD_MATERIAL );
+		write( material->getStaticFriction() );
+		write( material->getDynamicFriction() );
+		write( material->getRestitution() );
+		write( material->getFlags() );
+		write( (uint8_t)material->getFrictionCombineMode() );
+		write( (uint8_t)material->getRestitutionCombineMode() );
+		return index;
+	}
+
+	// Meshes are recorded as their cooked vertices and triangles, 
+	// and cooked again on playback
+	uint32_t getMeshIndex( PxBase* mesh )
+	{
+		map<const PxBase*, uint32_t>::iterator iter = mMeshes.find( mesh );
+		if ( iter != mMeshes.end() ) {
+			return iter->second;
+		}
+		uint32_t index	= (uint32_t)mMeshes.size();
+		mMeshes[ mesh ]	= index;
+
+		if ( mesh->getConcreteType() == PxConcreteType::eCONVEX_MESH ) {
+			const PxConvexMesh* convexMesh = static_cast<const PxConvexMesh*>( mesh );
+			writeOpcode( RECORD_CONVEX_MESH );
+			write( convexMesh->getNbVertices() );
+			mFile.write( (const char*)convexMesh->getVertices(), convexMesh->getNbVertices() * sizeof( PxVec3 ) );
+		} else {
+			const PxTriangleMesh* triangleMesh = static_cast<const PxTriangleMesh*>( mesh );
+			PxU32 numIndices	= triangleMesh->getNbTriangles() * 3;
+			bool shortIndices	= triangleMesh->getTriangleMeshFlags() & PxTriangleMeshFlag::eHAS_16BIT_TRIANGLE_INDICES;
+			writeOpcode( RECORD_TRIANGLE_MESH );
+			write( triangleMesh->getNbVertices() );
+			mFile.write( (const char*)triangleMesh->getVertices(), triangleMesh->getNbVertices() * sizeof( PxVec3 ) );
+			write( triangleMesh->getNbTriangles() );
+			for ( PxU32 i = 0; i < numIndices; ++i ) {
+				write( shortIndices ? 
+					   (uint32_t)static_cast<const PxU16*>( triangleMesh->getTriangles() )[ i ] : 
+					   (uint32_t)static_cast<const PxU32*>( triangleMesh->getTriangles() )[ i ] );
+			}
+		}
+		return index;
+	}
+
+	void writeGeometry( const PxGeometryHolder& geometry, uint32_t meshIndex )
+	{
+		write( (uint8_t)geometry.getType() );
+		switch ( geometry.getType() ) {
+		case PxGeometryType::eBOX:
+			write( geometry.box().halfExtents );
+			break;
+		case PxGeometryType::eCAPSULE:
+			write( geometry.capsule().radius );
+			write( geometry.capsule().halfHeight );
+			break;
+		case PxGeometryType::eCONVEXMESH:
+			write( meshIndex );
+			write( geometry.convexMesh().scale.scale );
+			write( geometry.convexMesh().scale.rotation );
+			break;
+		case PxGeometryType::eSPHERE:
+			write( geometry.sphere().radius );
+			break;
+		case PxGeometryType::eTRIANGLEMESH:
+			write( meshIndex );
+			write( geometry.triangleMesh().scale.scale );
+			write( geometry.triangleMesh().scale.rotation );
+			write( geometry.triangleMesh().meshFlags );
+			break;
+		case PxGeometryType::ePLANE:
+			break;
+		default:
+			CI_LOG_W( "Height fields are not recorded" );
+			break;
+		}
+	}
+
+	ofstream						mFile;
+	map<const PxBase*, uint32_t>	mMaterials;
+	map<const PxBase*, uint32_t>	mMeshes;
+};
+
+Physx::StepStats::StepStats()
+: mNumSteps( 0 )
+{
+	for ( size_t i = 0; i < STEP_TIMER_COUNT; ++i ) {
+		mTimes[ i ] = 0.0;
+	}
+}
+
+double Physx::StepStats::getTotal() const
+{
+	double total = 0.0;
+	for ( size_t i = 0; i < STEP_TIMER_COUNT; ++i ) {
+		total += mTimes[ i ];
+	}
+	return total;
+}
+
+Physx::TimingHistory::TimingHistory( size_t capacity )
+: mNext( 0 )
+{
+	mSamples.reserve( max<size_t>( capacity, 1 ) );
+}
+
+void Physx::TimingHistory::add( double value )
+{
+	if ( mSamples.size() < mSamples.capacity() ) {
+		mSamples.push_back( value );
+	} else {
+		mSamples[ mNext ] = value;
+	}
+	mNext = ( mNext + 1 ) % mSamples.capacity();
+}
+
+void Physx::TimingHistory::clear()
+{
+	mNext = 0;
+	mSamples.clear();
+}
+
+double Physx::TimingHistory::getAverage() const
+{
+	if ( mSamples.empty() ) {
+		return 0.0;
+	}
+	double total = 0.0;
+	for ( double v : mSamples ) {
+		total += v;
+	}
+	return total / (double)mSamples.size();
+}
+
+// Samples at or above maxValue land in the last bin
+vector<uint32_t> Physx::TimingHistory::getHistogram( size_t numBins, double maxValue ) const
+{
+	vector<uint32_t> bins( numBins, 0 );
+	if ( numBins == 0 || maxValue <= 0.0 ) {
+		return bins;
+	}
+	for ( double v : mSamples ) {
+		size_t bin = (size_t)( max( v, 0.0 ) / maxValue * (double)numBins );
+		++bins[ min( bin, numBins - 1 ) ];
+	}
+	return bins;
+}
+
+double Physx::TimingHistory::getMax() const
+{
+	return mSamples.empty() ? 0.0 : *max_element( mSamples.begin(), mSamples.end() );
+}
+
+size_t Physx::TimingHistory::getNumSamples() const
+{
+	return mSamples.size();
+}
+
+double Physx::TimingHistory::getPercentile( double percentile ) const
+{
+	if ( mSamples.empty() ) {
+		return 0.0;
+	}
+	vector<double> sorted( mSamples );
+	size_t index = (size_t)( min( max( percentile, 0.0 ), 1.0 ) * (double)( sorted.size() - 1 ) + 0.5 );
+	nth_element( sorted.begin(), sorted.begin() + index, sorted.end() );
+	return sorted[ index ];
+}
+
+// Sits in front of every block and keeps the payload 16-byte aligned
+struct Physx::PoolAllocator::Header
+{
+	uint64_t	mSize;
+	uint32_t	mSizeClass;
+	uint32_t	mType;
+};
+
+Physx::PoolAllocator::Stats::Stats()
+: mAllocationsPerFrame( 0 ), mBytesLive( 0 ), mBytesPeak( 0 ), mNumAllocations( 0 )
+{
+}
+
+Physx::PoolAllocator::SizeClass::SizeClass()
+: mFreeBlocks( nullptr )
+{
+}
+
+Physx::PoolAllocator::TypeStats::TypeStats()
+: mAllocationsPerFrame( 0 ), mBytesLive( 0 ), mBytesPeak( 0 ), mFrameAllocations( 0 ), mName( nullptr ), 
+mNumAllocations( 0 )
+{
+}
+
+Physx::PoolAllocator::Stats Physx::PoolAllocator::TypeStats::load() const
+{
+	Stats stats;
+	stats.mAllocationsPerFrame	= mAllocationsPerFrame.load( memory_order_relaxed );
+	stats.mBytesLive			= mBytesLive.load( memory_order_relaxed );
+	stats.mBytesPeak			= mBytesPeak.load( memory_order_relaxed );
+	stats.mNumAllocations		= mNumAllocations.load( memory_order_relaxed );
+	return stats;
+}
+
+Physx::PoolAllocator::PoolAllocator()
+: mSizeClasses( new SizeClass[ kPoolNumClasses ] ), mTypeStats( new TypeStats[ kPoolMaxTypes + 1 ] )
+{
+	static_assert( sizeof( Header ) == 16, "Pool block header must preserve 16-byte alignment" );
+	mTypeStats[ kPoolMaxTypes ].mName = "other";
+}
+
+Physx::PoolAllocator::~PoolAllocator()
+{
+	for ( void* chunk : mChunks ) {
+		alignedFree( chunk );
+	}
+}
+
+void* Physx::PoolAllocator::allocate( size_t size, const char* typeName, const char*, int )
+{
+	size_t total		= size + sizeof( Header );
+	uint32_t sizeClass	= 0;
+	while ( sizeClass < kPoolNumClasses && ( kPoolMinBlockSize << sizeClass ) < total ) {
+		++sizeClass;
+	}
+
+	Header* header = nullptr;
+	if ( sizeClass < kPoolNumClasses ) {
+		SizeClass& sc = mSizeClasses[ sizeClass ];
+		lock_guard<mutex> lock( sc.mMutex );
+
+		// Refill an empty class with a fresh chunk cut into blocks
+		if ( sc.mFreeBlocks == nullptr ) {
+			uint8_t* chunk = (uint8_t*)alignedAlloc( kPoolChunkSize );
+			if ( chunk == nullptr ) {
+				return nullptr;
+			}
+			{
+				lock_guard<mutex> chunkLock( mChunkMutex );
+				mChunks.push_back( chunk );
+			}
+			size_t blockSize = kPoolMinBlockSize << sizeClass;
+			for ( size_t offset = 0; offset + blockSize <= kPoolChunkSize; offset += blockSize ) {
+				*(void**)( chunk + offset )	= sc.mFreeBlocks;
+				sc.mFreeBlocks				= chunk + offset;
+			}
+		}
+		header			= (Header*)sc.mFreeBlocks;
+		sc.mFreeBlocks	= *(void**)header;
+	} else {
+		header = (Header*)alignedAlloc( total );
+		if ( header == nullptr ) {
+			return nullptr;
+		}
+		sizeClass = kPoolClassLarge;
+	}
+	header->mSize		= size;
+	header->mSizeClass	= sizeClass;
+	header->mType		= getTypeIndex( typeName );
+
+	track( mTypeStats[ header->mType ], size );
+	track( mTotalStats, size );
+	return header + 1;
+}
+
+void Physx::PoolAllocator::deallocate( void* ptr )
+{
+	if ( ptr == nullptr ) {
+		return;
+	}
+	Header* header = (Header*)ptr - 1;
+
+	TypeStats& stats = mTypeStats[ header->mType ];
+	stats.mBytesLive.fetch_sub( (size_t)header->mSize, memory_order_relaxed );
+	stats.mNumAllocations.fetch_sub( 1, memory_order_relaxed );
+	mTotalStats.mBytesLive.fetch_sub( (size_t)header->mSize, memory_order_relaxed );
+	mTotalStats.mNumAllocations.fetch_sub( 1, memory_order_relaxed );
+
+	if ( header->mSizeClass == kPoolClassLarge ) {
+		alignedFree( header );
+	} else {
+		SizeClass& sc = mSizeClasses[ header->mSizeClass ];
+		lock_guard<mutex> lock( sc.mMutex );
+		*(void**)header	= sc.mFreeBlocks;
+		sc.mFreeBlocks	= header;
+	}
+}
+
+map<string, Physx::PoolAllocator::Stats> Physx::PoolAllocator::getStats() const
+{
+	// The same name can arrive through different string literals, so 
+	// entries are merged by value here
+	map<string, Stats> stats;
+	for ( uint32_t i = 0; i <= kPoolMaxTypes; ++i ) {
+		const char* name = mTypeStats[ i ].mName.load( memory_order_acquire );
+		if ( name == nullptr ) {
+			continue;
+		}
+		Stats type				= mTypeStats[ i ].load();
+		Stats& s				= stats[ name ];
+		s.mAllocationsPerFrame	+= type.mAllocationsPerFrame;
+		s.mBytesLive			+= type.mBytesLive;
+		s.mBytesPeak			+= type.mBytesPeak;
+		s.mNumAllocations		+= type.mNumAllocations;
+	}
+	return stats;
+}
+
+Physx::PoolAllocator::Stats Physx::PoolAllocator::getTotalStats() const
+{
+	return mTotalStats.load();
+}
+
+void Physx::PoolAllocator::nextFrame()
+{
+	for ( uint32_t i = 0; i <= kPoolMaxTypes; ++i ) {
+		TypeStats& stats = mTypeStats[ i ];
+		stats.mAllocationsPerFrame.store( stats.mFrameAllocations.exchange( 0, memory_order_relaxed ), memory_order_relaxed );
+	}
+	mTotalStats.mAllocationsPerFrame.store( mTotalStats.mFrameAllocations.exchange( 0, memory_order_relaxed ), memory_order_relaxed );
+}
+
+uint32_t Physx::PoolAllocator::getTypeIndex( const char* typeName )
+{
+	if ( typeName == nullptr ) {
+		typeName = "unknown";
+	}
+
+	// Open addressing on the name pointer. Entries are claimed with a 
+	// compare-exchange and never given back, so lookups take no lock.
+	uint64_t hash	= (uint64_t)(uintptr_t)typeName * 0x9e3779b97f4a7c15ULL;
+	uint32_t index	= (uint32_t)( hash >> 32 ) & ( kPoolMaxTypes - 1 );
+	for ( uint32_t probe = 0; probe < kPoolMaxTypes; ++probe, index = ( index + 1 ) & ( kPoolMaxTypes - 1 ) ) {
+		const char* name = mTypeStats[ index ].mName.load( memory_order_acquire );
+		if ( name == nullptr ) {
+			const char* expected = nullptr;
+			if ( mTypeStats[ index ].mName.compare_exchange_strong( expected, typeName, memory_order_acq_rel ) ) {
+				return index;
+			}
+			name = expected;
+		}
+		if ( name == typeName ) {
+			return index;
+		}
+	}
+	return kPoolMaxTypes;
+}
+
+void Physx::PoolAllocator::track( TypeStats& stats, size_t size )
+{
+	size_t live = stats.mBytesLive.fetch_add( size, memory_order_relaxed ) + size;
+	size_t peak = stats.mBytesPeak.load( memory_order_relaxed );
+	while ( live > peak && !stats.mBytesPeak.compare_exchange_weak( peak, live, memory_order_relaxed ) ) {
+	}
+	stats.mFrameAllocations.fetch_add( 1, memory_order_relaxed );
+	stats.mNumAllocations.fetch_add( 1, memory_order_relaxed );
+}
+
+struct Physx::CpuDispatcher::Worker
+{
+	deque<function<void()>>	mJobs;
+	mutex					mMutex;
+	thread					mThread;
+};
+
+Physx::CpuDispatcher::CpuDispatcher( uint32_t numThreads, const vector<uint64_t>& affinityMasks )
+: mNextWorker( 0 ), mNumPending( 0 ), mRunning( true )
+{
+	numThreads = max<uint32_t>( numThreads, 1 );
+	for ( uint32_t i = 0; i < numThreads; ++i ) {
+		mWorkers.push_back( unique_ptr<Worker>( new Worker() ) );
+	}
+
+	// Threads start once every deque exists so stealing never sees a 
+	// half-built worker list
+	for ( size_t i = 0; i < mWorkers.size(); ++i ) {
+		mWorkers[ i ]->mThread = thread( &CpuDispatcher::run, this, i );
+
+		uint64_t mask = i < affinityMasks.size() ? affinityMasks[ i ] : 0;
+		if ( mask != 0 ) {
+#if defined( CINDER_MSW )
+			SetThreadAffinityMask( mWorkers[ i ]->mThread.native_handle(), (DWORD_PTR)mask );
+#elif defined( __linux__ )
+			cpu_set_t cpuSet;
+			CPU_ZERO( &cpuSet );
+			for ( uint32_t cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu ) {
+				if ( ( mask >> cpu ) & 1 ) {
+					CPU_SET( cpu, &cpuSet );
+				}
+			}
+			pthread_setaffinity_np( mWorkers[ i ]->mThread.native_handle(), sizeof( cpu_set_t ), &cpuSet );
+#endif
+		}
+	}
+}
+
+Physx::CpuDispatcher::~CpuDispatcher()
+{
+	// Workers drain whatever is queued before exiting
+	{
+		lock_guard<mutex> lock( mSleepMutex );
+		mRunning = false;
+	}
+	mCondition.notify_all();
+	for ( unique_ptr<Worker>& worker : mWorkers ) {
+		worker->mThread.join();
+	}
+}
+
+PxU32 Physx::CpuDispatcher::getWorkerCount() const
+{
+	return (PxU32)mWorkers.size();
+}
+
+void Physx::CpuDispatcher::submit( const function<void()>& job )
+{
+	// Jobs spawned by a worker stay on its own deque, where they are 
+	// likely to find warm caches. Everything else is spread round-robin.
+	size_t index = getWorkerIndex();
+	if ( index >= mWorkers.size() ) {
+		index = mNextWorker++ % mWorkers.size();
+	}
+	{
+		lock_guard<mutex> lock( mSleepMutex );
+		++mNumPending;
+	}
+	{
+		lock_guard<mutex> lock( mWorkers[ index ]->mMutex );
+		mWorkers[ index ]->mJobs.push_back( job );
+	}
+	mCondition.notify_one();
+}
+
+void Physx::CpuDispatcher::submitTask( PxBaseTask& task )
+{
+	PxBaseTask* t = &task;
+	submit( [ t ]()
+	{
+		t->run();
+		t->release();
+	} );
+}
+
+size_t Physx::CpuDispatcher::getWorkerIndex() const
+{
+	thread::id id = this_thread::get_id();
+	for ( size_t i = 0; i < mWorkers.size(); ++i ) {
+		if ( mWorkers[ i ]->mThread.get_id() == id ) {
+			return i;
+		}
+	}
+	return mWorkers.size();
+}
+
+bool Physx::CpuDispatcher::pop( size_t index, function<void()>& job )
+{
+	// Newest from our own deque, otherwise oldest from someone else's
+	size_t count = mWorkers.size();
+	for ( size_t i = 0; i < count; ++i ) {
+		Worker& worker = *mWorkers[ ( index + i ) % count ];
+		lock_guard<mutex> lock( worker.mMutex );
+		if ( !worker.mJobs.empty() ) {
+			if ( i == 0 ) {
+				job = worker.mJobs.back();
+				worker.mJobs.pop_back();
+			} else {
+				job = worker.mJobs.front();
+				worker.mJobs.pop_front();
+			}
+			--mNumPending;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Physx::CpuDispatcher::run( size_t index )
+{
+	function<void()> job;
+	while ( true ) {
+		if ( pop( index, job ) ) {
+			job();
+			job = nullptr;
+			continue;
+		}
+
+		unique_lock<mutex> lock( mSleepMutex );
+		mCondition.wait( lock, [ this ]() -> bool
+		{
+			return !mRunning || mNumPending > 0;
+		} );
+		if ( !mRunning && mNumPending == 0 ) {
+			return;
+		}
+	}
+}
+
+// Marks the stream invalid instead of reading past its end
+template<typename T>
+T Physx::Player::read()
+{
+	T value = T();
+	if ( !mValid || mOffset + sizeof( T ) > mData.size() ) {
+		mValid = false;
+		return value;
+	}
+	memcpy( &value, &mData[ mOffset ], sizeof( T ) );
+	mOffset += sizeof( T );
+	return value;
+}
+
+Physx::Player::Player( Physx& physx, const fs::path& path )
+: mNumUpdates( 0 ), mOffset( 0 ), mPhysx( physx ), mValid( false )
+{
+	ifstream file( path.string().c_str(), ios::binary );
+	if ( !file.is_open() ) {
+		CI_LOG_E( "Unable to open recording " << path );
+		return;
+	}
+	mData.assign( istreambuf_iterator<char>( file ), istreambuf_iterator<char>() );
+	mValid = true;
+	if ( read<uint32_t>() != kRecordMagic || read<uint32_t>() != kRecordVersion ) {
+		CI_LOG_E( "Unsupported recording " << path );
+		mValid = false;
+	}
+}
+
+Physx::Player::~Player()
+{
+	// Shapes hold their own references
+	for ( PxMaterial* material : mMaterials ) {
+		material->release();
+	}
+	for ( PxBase* mesh : mMeshes ) {
+		if ( mesh != nullptr ) {
+			mesh->release();
+		}
+	}
+}
+
+uint32_t Physx::Player::getActorId( uint32_t recordedId ) const
+{
+	map<uint32_t, uint32_t>::const_iterator iter = mActorIds.find( recordedId );
+	return iter == mActorIds.end() ? kInvalidId : iter->second;
+}
+
+size_t Physx::Player::getNumUpdates() const
+{
+	return mNumUpdates;
+}
+
+bool Physx::Player::isFinished() const
+{
+	return !mValid || mOffset >= mData.size();
+}
+
+bool Physx::Player::isValid() const
+{
+	return mValid;
+}
+
+bool Physx::Player::step()
+{
+	while ( !isFinished() ) {
+		uint8_t opcode = read<uint8_t>();
+		switch ( opcode ) {
+		case RECORD_ADD_ACTOR:
+			readActor();
+			break;
+		case RECORD_ADD_FORCE:
+		case RECORD_ADD_TORQUE:
+		case RECORD_SET_ANGULAR_VELOCITY:
+		case RECORD_SET_LINEAR_VELOCITY:
+			{
+				uint32_t id		= getActorId( read<uint32_t>() );
+				vec3 v			= from( read<PxVec3>() );
+				if ( opcode == RECORD_SET_ANGULAR_VELOCITY ) {
+					mPhysx.setAngularVelocity( id, v );
+				} else if ( opcode == RECORD_SET_LINEAR_VELOCITY ) {
+					mPhysx.setLinearVelocity( id, v );
+				} else {
+					PxForceMode::Enum mode = (PxForceMode::Enum)read<uint8_t>();
+					if ( opcode == RECORD_ADD_FORCE ) {
+						mPhysx.addForce( id, v, mode );
+					} else {
+						mPhysx.addTorque( id, v, mode );
+					}
+				}
+			}
+			break;
+		case RECORD_CLEAR_ACTORS:
+			mPhysx.clearActors();
+			mActorIds.clear();
+			break;
+		case RECORD_CONVEX_MESH:
+		case RECORD_TRIANGLE_MESH:
+			readMesh( opcode );
+			break;
+		case RECORD_CREATE_SCENE:
+			{
+				uint32_t recordedId		= read<uint32_t>();
+				PxSceneDesc desc		= mPhysx.createSceneDesc( (PxBroadPhaseType::Enum)read<uint8_t>() );
+				desc.gravity			= read<PxVec3>();
+				desc.flags				= read<PxSceneFlags>();
+				desc.frictionType		= (PxFrictionType::Enum)read<uint8_t>();
+				vector<PxBounds3> regions( read<uint32_t>() );
+				for ( PxBounds3& bounds : regions ) {
+					bounds = read<PxBounds3>();
+				}
+				if ( mValid ) {
+					mSceneIds[ recordedId ] = mPhysx.createScene( desc, regions );
+				}
+			}
+			break;
+		case RECORD_DISABLE_FIXED_TIMESTEP:
+			mPhysx.disableFixedTimestep();
+			break;
+		case RECORD_ENABLE_FIXED_TIMESTEP:
+			{
+				float stepInSeconds		= read<float>();
+				uint32_t maxSubsteps	= read<uint32_t>();
+				mPhysx.enableFixedTimestep( stepInSeconds, maxSubsteps );
+			}
+			break;
+		case RECORD_ERASE_ACTOR:
+			{
+				uint32_t recordedId = read<uint32_t>();
+				mPhysx.eraseActor( getActorId( recordedId ) );
+				mActorIds.erase( recordedId );
+			}
+			break;
+		case RECORD_ERASE_SCENE:
+			{
+				uint32_t recordedId = read<uint32_t>();
+				mPhysx.eraseScene( getSceneId( recordedId ) );
+				mSceneIds.erase( recordedId );
+			}
+			break;
+		case RECORD_FILTER_DATA:
+			{
+				PxActor* actor			= mPhysx.getActor( getActorId( read<uint32_t>() ) );
+				PxFilterData filterData	= read<PxFilterData>();
+				if ( actor != nullptr && ( actor->getType() == PxActorType::eRIGID_DYNAMIC || 
+										   actor->getType() == PxActorType::eRIGID_STATIC ) ) {
+					mPhysx.setFilterData( *static_cast<PxRigidActor*>( actor ), filterData );
+				}
+			}
+			break;
+		case RECORD_FILTER_SHADER_DATA:
+			mPhysx.setFilterShaderData( read<FilterShaderData>() );
+			break;
+		case RECORD_MATERIAL:
+			{
+				PxReal staticFriction	= read<PxReal>();
+				PxReal dynamicFriction	= read<PxReal>();
+				PxReal restitution		= read<PxReal>();
+				PxMaterial* material	= mPhysx.getPhysics()->createMaterial( staticFriction, dynamicFriction, restitution );
+				material->setFlags( read<PxMaterialFlags>() );
+				material->setFrictionCombineMode( (PxCombineMode::Enum)read<uint8_t>() );
+				material->setRestitutionCombineMode( (PxCombineMode::Enum)read<uint8_t>() );
+				mMaterials.push_back( material );
+			}
+			break;
+		case RECORD_SCENE_ENABLED:
+			{
+				uint32_t id = getSceneId( read<uint32_t>() );
+				mPhysx.setSceneEnabled( id, read<uint8_t>() != 0 );
+			}
+			break;
+		case RECORD_SCENE_PRIORITY:
+			{
+				uint32_t id = getSceneId( read<uint32_t>() );
+				mPhysx.setScenePriority( id, read<int32_t>() );
+			}
+			break;
+		case RECORD_SET_GLOBAL_POSE:
+		case RECORD_SET_KINEMATIC_TARGET:
+			{
+				uint32_t id			= getActorId( read<uint32_t>() );
+				PxTransform pose	= read<PxTransform>();
+				if ( opcode == RECORD_SET_GLOBAL_POSE ) {
+					mPhysx.setGlobalPose( id, pose );
+				} else {
+					mPhysx.setKinematicTarget( id, pose );
+				}
+			}
+			break;
+		case RECORD_UPDATE:
+			{
+				float deltaInSeconds = read<float>();
+				if ( mValid ) {
+					mPhysx.update( deltaInSeconds );
+					++mNumUpdates;
+				}
+			}
+			return mValid;
+		default:
+			CI_LOG_E( "Unknown opcode " << (uint32_t)opcode << " at offset " << mOffset - 1 );
+			mValid = false;
+			break;
+		}
+	}
+	return false;
+}
+
+uint32_t Physx::Player::getSceneId( uint32_t recordedId ) const
+{
+	map<uint32_t, uint32_t>::const_iterator iter = mSceneIds.find( recordedId );
+	return iter == mSceneIds.end() ? kInvalidId : iter->second;
+}
+
+void Physx::Player::readActor()
+{
+	uint32_t sceneId				= getSceneId( read<uint32_t>() );
+	uint32_t recordedId				= read<uint32_t>();
+	uint8_t type					= read<uint8_t>();
+	PxTransform pose				= read<PxTransform>();
+	PxActorFlags actorFlags			= read<PxActorFlags>();
+	PxDominanceGroup dominanceGroup	= read<PxDominanceGroup>();
+	if ( !mValid ) {
+		return;
+	}
+
+	PxPhysics* physics		= mPhysx.getPhysics();
+	PxRigidActor* actor		= nullptr;
+	PxRigidDynamic* body	= nullptr;
+	PxVec3 angularVelocity( 0.0f );
+	PxVec3 linearVelocity( 0.0f );
+	bool sleeping			= false;
+	if ( type == PxActorType::eRIGID_DYNAMIC ) {
+		body = physics->createRigidDynamic( pose );
+		body->setMass( read<PxReal>() );
+		body->setMassSpaceInertiaTensor( read<PxVec3>() );
+		body->setCMassLocalPose( read<PxTransform>() );
+		body->setLinearDamping( read<PxReal>() );
+		body->setAngularDamping( read<PxReal>() );
+		body->setMaxAngularVelocity( read<PxReal>() );
+		linearVelocity			= read<PxVec3>();
+		angularVelocity			= read<PxVec3>();
+		body->setRigidBodyFlags( read<PxRigidBodyFlags>() );
+		PxU32 positionIterations	= read<PxU32>();
+		PxU32 velocityIterations	= read<PxU32>();
+		body->setSolverIterationCounts( positionIterations, velocityIterations );
+		body->setSleepThreshold( read<PxReal>() );
+		sleeping				= read<uint8_t>() != 0;
+		actor					= body;
+	} else {
+		actor = physics->createRigidStatic( pose );
+	}
+	actor->setActorFlags( actorFlags );
+	actor->setDominanceGroup( dominanceGroup );
+
+	uint32_t numShapes = read<uint32_t>();
+	for ( uint32_t i = 0; i < numShapes && mValid; ++i ) {
+		PxGeometryHolder geometry;
+		bool supported					= readGeometry( geometry );
+		PxTransform localPose			= read<PxTransform>();
+		PxShapeFlags shapeFlags			= read<PxShapeFlags>();
+		PxFilterData simulationFilter	= read<PxFilterData>();
+		PxFilterData queryFilter		= read<PxFilterData>();
+		PxReal contactOffset			= read<PxReal>();
+		PxReal restOffset				= read<PxReal>();
+		vector<PxMaterial*> materials;
+		uint16_t numMaterials			= read<uint16_t>();
+		for ( uint16_t j = 0; j < numMaterials; ++j ) {
+			uint32_t index = read<uint32_t>();
+			if ( index < mMaterials.size() ) {
+				materials.push_back( mMaterials[ index ] );
+			}
+		}
+		if ( !supported || materials.empty() || !mValid ) {
+			continue;
+		}
+
+		PxShape* shape = actor->createShape( geometry.any(), &materials[ 0 ], (PxU16)materials.size(), shapeFlags );
+		if ( shape != nullptr ) {
+			shape->setLocalPose( localPose );
+			shape->setSimulationFilterData( simulationFilter );
+			shape->setQueryFilterData( queryFilter );
+			shape->setContactOffset( contactOffset );
+			shape->setRestOffset( restOffset );
+		}
+	}
+
+	if ( !mValid || mPhysx.getScene( sceneId ) == nullptr ) {
+		actor->release();
+		return;
+	}
+	mActorIds[ recordedId ] = mPhysx.addActor( actor, sceneId );
+
+	// Kinematic bodies don't take velocities, and sleep state 
+	// only sticks once the body is in a scene
+	if ( body != nullptr ) {
+		if ( !( body->getRigidBodyFlags() & PxRigidBodyFlag::eKINEMATIC ) ) {
+			body->setLinearVelocity( linearVelocity, false );
+			body->setAngularVelocity( angularVelocity, false );
+		}
+		if ( sleeping ) {
+			body->putToSleep();
+		}
+	}
+}
+
+bool Physx::Player::readGeometry( PxGeometryHolder& geometry )
+{
+	switch ( read<uint8_t>() ) {
+	case PxGeometryType::eBOX:
+		geometry = PxBoxGeometry( read<PxVec3>() );
+		return true;
+	case PxGeometryType::eCAPSULE:
+		{
+			PxReal radius		= read<PxReal>();
+			PxReal halfHeight	= read<PxReal>();
+			geometry			= PxCapsuleGeometry( radius, halfHeight );
+		}
+		return true;
+	case PxGeometryType::eCONVEXMESH:
+		{
+			uint32_t index	= read<uint32_t>();
+			PxVec3 scale	= read<PxVec3>();
+			PxQuat rotation	= read<PxQuat>();
+			if ( index < mMeshes.size() && mMeshes[ index ] != nullptr ) {
+				geometry = PxConvexMeshGeometry( static_cast<PxConvexMesh*>( mMeshes[ index ] ), 
+												 PxMeshScale( scale, rotation ) );
+				return true;
+			}
+		}
+		return false;
+	case PxGeometryType::ePLANE:
+		geometry = PxPlaneGeometry();
+		return true;
+	case PxGeometryType::eSPHERE:
+		geometry = PxSphereGeometry( read<PxReal>() );
+		return true;
+	case PxGeometryType::eTRIANGLEMESH:
+		{
+			uint32_t index				= read<uint32_t>();
+			PxVec3 scale				= read<PxVec3>();
+			PxQuat rotation				= read<PxQuat>();
+			PxMeshGeometryFlags flags	= read<PxMeshGeometryFlags>();
+			if ( index < mMeshes.size() && mMeshes[ index ] != nullptr ) {
+				geometry = PxTriangleMeshGeometry( static_cast<PxTriangleMesh*>( mMeshes[ index ] ), 
+												   PxMeshScale( scale, rotation ), flags );
+				return true;
+			}
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+void Physx::Player::readMesh( uint8_t opcode )
+{
+	uint32_t numVertices = read<uint32_t>();
+	if ( !mValid || numVertices > ( mData.size() - mOffset ) / sizeof( PxVec3 ) ) {
+		mValid = false;
+		return;
+	}
+	vector<vec3> positions( numVertices );
+	for ( vec3& position : positions ) {
+		position = from( read<PxVec3>() );
+	}
+
+	// A failed cook leaves a null entry so later indices still line up
+	if ( opcode == RECORD_CONVEX_MESH ) {
+		mMeshes.push_back( mPhysx.createConvexMesh( positions ) );
+		return;
+	}
+	uint32_t numTriangles = read<uint32_t>();
+	if ( !mValid || numTriangles > ( mData.size() - mOffset ) / ( sizeof( uint32_t ) * 3 ) ) {
+		mValid = false;
+		return;
+	}
+	vector<uint32_t> indices( numTriangles * 3 );
+	for ( uint32_t& index : indices ) {
+		index = read<uint32_t>();
+	}
+	mMeshes.push_back( mPhysx.createTriangleMesh( positions, numTriangles, indices ) );
+}
+
+Physx::Options::Options()
+: mAllocator( nullptr ), mCommandQueueSize( 0 ), mConnectToPvd( true ), mCookingParams( createCookingParams( PxTolerancesScale() ) ), 
+mCookingParamsSet( false ), mCpuDispatcher( nullptr ), mEventBufferSize( 4096 ), 
+mNumThreads( max<uint32_t>( (uint32_t)System::getNumCores(), 2 ) - 1 ), mPoolAllocator( false )
+{
+}
+
+Physx::Options& Physx::Options::affinityMasks( const vector<uint64_t>& masks )
+{
+	mAffinityMasks = masks;
+	return *this;
+}
+
+Physx::Options& Physx::Options::cpuDispatcher( PxCpuDispatcher* dispatcher )
+{
+	mCpuDispatcher = dispatcher;
+	return *this;
+}
+
+Physx::Options& Physx::Options::eventBufferSize( size_t count )
+{
+	mEventBufferSize = count;
+	return *this;
+}
+
+Physx::Options& Physx::Options::numThreads( uint32_t count )
+{
+	mNumThreads = count;
+	return *this;
+}
+
+Physx::Options& Physx::Options::allocator( PxAllocatorCallback* allocator )
+{
+	mAllocator = allocator;
+	return *this;
+}
+
+Physx::Options& Physx::Options::commandQueueSize( size_t count )
+{
+	mCommandQueueSize = count;
+	return *this;
+}
+
+Physx::Options& Physx::Options::connectToPvd( bool enable )
+{
+	mConnectToPvd = enable;
+	return *this;
+}
+
+Physx::Options& Physx::Options::cookingParams( const PxCookingParams& params )
+{
+	mCookingParams		= params;
+	mCookingParamsSet	= true;
+	return *this;
+}
+
+Physx::Options& Physx::Options::poolAllocator( bool enable )
+{
+	mPoolAllocator = enable;
+	return *this;
+}
+
+Physx::Options& Physx::Options::scale( const PxTolerancesScale& scale )
+{
+	mScale = scale;
+	if ( !mCookingParamsSet ) {
+		mCookingParams = createCookingParams( scale );
+	}
+	return *this;
+}
+
+PxAllocatorCallback* Physx::Options::getAllocator() const
+{
+	return mAllocator;
+}
+
+const vector<uint64_t>& Physx::Options::getAffinityMasks() const
+{
+	return mAffinityMasks;
+}
+
+size_t Physx::Options::getCommandQueueSize() const
+{
+	return mCommandQueueSize;
+}
+
+const PxCookingParams& Physx::Options::getCookingParams() const
+{
+	return mCookingParams;
+}
+
+PxCpuDispatcher* Physx::Options::getCpuDispatcher() const
+{
+	return mCpuDispatcher;
+}
+
+size_t Physx::Options::getEventBufferSize() const
+{
+	return mEventBufferSize;
+}
+
+uint32_t Physx::Options::getNumThreads() const
+{
+	return mNumThreads;
+}
+
+const PxTolerancesScale& Physx::Options::getScale() const
+{
+	return mScale;
+}
+
+bool Physx::Options::isConnectToPvdEnabled() const
+{
+	return mConnectToPvd;
+}
+
+bool Physx::Options::isPoolAllocatorEnabled() const
+{
+	return mPoolAllocator;
+}
+
+PhysxRef Physx::create( const Options& options )
+{
+	return PhysxRef( new Physx( options ) );
+}
+
+#if defined( CINDER_COCOA_TOUCH )
+PhysxRef Physx::create()
+{
+	return create( Options() );
+}
+
+PhysxRef Physx::create( const PxTolerancesScale& scale )
+{
+	return create( Options().scale( scale ) );
+}
+
+PhysxRef Physx::create( const PxTolerancesScale& scale, const PxCookingParams& params )
+{
+	return create( Options().scale( scale ).cookingParams( params ) );
+}
+#else
+PhysxRef Physx::create( bool connectToPvd )
+{
+	return create( Options().connectToPvd( connectToPvd ) );
+}
+
+PhysxRef Physx::create( const PxTolerancesScale& scale, bool connectToPvd )
+{
+	return create( Options().scale( scale ).connectToPvd( connectToPvd ) );
+}
+
+PhysxRef Physx::create( const PxTolerancesScale& scale, const PxCookingParams& params, bool connectToPvd )
+{
+	return create( Options().scale( scale ).cookingParams( params ).connectToPvd( connectToPvd ) );
+}
+#endif
+
+Physx::Physx( const Options& options )
+: mAccumulator( 0.0f ), mAlive( make_shared<atomic<bool>>( true ) ), mAllocator( nullptr ), mCooking( nullptr ), mCookingCacheParams( 0 ), mCpuDispatcher( nullptr ), 
+mFixedTimestep( 0.0f ), mFoundation( nullptr ), mMaxSubsteps( 1 ), mNumActorChanges( 0 ), mNumClearedActors( 0 ), 
+mPhysics( nullptr ), mPoolAllocator( nullptr ), mProfileZoneManager( nullptr )
+#if !defined( CINDER_COCOA_TOUCH )
+, mPvdConnection( nullptr )
+#endif
+#if PX_SUPPORT_GPU_PHYSX
+, mCudaContextManager( nullptr )
+#endif
+{
+	const PxTolerancesScale& scale	= options.getScale();
+	const PxCookingParams& params	= options.getCookingParams();
+#if !defined( CINDER_COCOA_TOUCH )
+	bool connectToPvd				= options.isConnectToPvdEnabled();
+#endif
+
+	mEventBufferSize				= options.getEventBufferSize();
+	mStepStatsReady					= false;
+	if ( options.getCommandQueueSize() > 0 ) {
+		mCommandQueue.reset( new CommandQueue( options.getCommandQueueSize() ) );
+		reserveActorIds();
+	}
+
+	// A caller's allocator must outlive this instance
+	if ( options.getAllocator() != nullptr ) {
+		mAllocator		= options.getAllocator();
+		mPoolAllocator	= dynamic_cast<PoolAllocator*>( mAllocator );
+	} else if ( options.isPoolAllocatorEnabled() ) {
+		mPoolAllocator	= new PoolAllocator();
+		mAllocator		= mPoolAllocator;
+		mOwnedAllocator.reset( mPoolAllocator );
+	} else {
+		mAllocator		= new PxDefaultAllocator();
+		mOwnedAllocator.reset( mAllocator );
+	}
+
+	mFoundation = PxCreateFoundation( PX_PHYSICS_VERSION, *mAllocator, getErrorCallback() );
+	CI_ASSERT( mFoundation != nullptr );
+	if ( mPoolAllocator != nullptr ) {
+
+		// Release builds pass null type names unless asked, which would 
+		// lump every allocation together
+		mFoundation->setReportAllocationNames( true );
+	}
+
+#if !defined( CINDER_COCOA_TOUCH )
+	if ( connectToPvd ) {
+		mProfileZoneManager = &PxProfileZoneManager::createProfileZoneManager( mFoundation );
+		CI_ASSERT( mProfileZoneManager != nullptr );
+	}
+#endif
+
+#if defined( CINDER_COCOA_TOUCH )
+	mPhysics = PxCreatePhysics( PX_PHYSICS_VERSION, *mFoundation, scale, false, mProfileZoneManager );
+#else
+	mPhysics = PxCreatePhysics( PX_PHYSICS_VERSION, *mFoundation, scale, connectToPvd, mProfileZoneManager );
+#endif
+	CI_ASSERT( mPhysics != nullptr );
+	CI_ASSERT( PxInitExtensions( *mPhysics ) );
+
+	mCooking = PxCreateCooking( PX_PHYSICS_VERSION, *mFoundation, params );
+	CI_ASSERT( mCooking != nullptr );
+
+	// Leave a core for the main thread by default. A caller's dispatcher 
+	// must outlive this instance.
+	if ( options.getCpuDispatcher() != nullptr ) {
+		mCpuDispatcher = options.getCpuDispatcher();
+	} else {
+		mOwnedCpuDispatcher.reset( new CpuDispatcher( options.getNumThreads(), options.getAffinityMasks() ) );
+		mCpuDispatcher = mOwnedCpuDispatcher.get();
+	}
+
+#if PX_SUPPORT_GPU_PHYSX
+	PxCudaContextManagerDesc cudaContextManagerDesc;
+	mCudaContextManager = PxCreateCudaContextManager( *mFoundation, cudaContextManagerDesc, mProfileZoneManager );
+	if ( mCudaContextManager && !mCudaContextManager->contextIsValid() ) {
+		mCudaContextManager->release();
+		mCudaContextManager = nullptr;
+	}
+#endif
+
+#if !defined( CINDER_COCOA_TOUCH )
+	if ( connectToPvd && mPhysics->getPvdConnectionManager() ) {
+		mPhysics->getPvdConnectionManager()->addHandler( *this );
+	}
+#endif
+}
+
+Physx::~Physx()
+{
+	*mAlive = false;
+	endUpdate();
+#if !defined( CINDER_COCOA_TOUCH )
+	pvdDisconnect();
+#endif
+
+	// Queued actors were never added, so nothing else releases them
+	if ( mCommandQueue ) {
+		Command command;
+		while ( mCommandQueue->mCommands.pop( command ) ) {
+			if ( command.mType == COMMAND_ADD_ACTOR ) {
+				command.mActor->release();
+			}
+		}
+	}
+
+	for ( auto& iter : mActors ) {
+		mActorPoolKeys.erase( iter.second );
+		iter.second->release();
+	}
+	mActors.clear();
+	clearActorPool();
+	for ( auto& iter : mShapeCache ) {
+		iter.second->release();
+	}
+	mShapeCache.clear();
+	mShapeRefs.clear();
+	for ( auto& iter : mMaterialCache ) {
+		iter.second->release();
+	}
+	mMaterialCache.clear();
+	mMaterialRefs.clear();
+	mActorSlots.clear();
+	mFreeActorSlots.clear();
+	mPreviousPoses.clear();
+
+	for ( auto& iter : mScenes ) {
+		mSceneInfo[ iter.first ].mBatchQueries.clear();
+		iter.second->release();
+	}
+	mScenes.clear();
+
+	mCookingPool.reset();
+	if ( mCooking != nullptr ) {
+		mCooking->release();
+		mCooking = nullptr;
+	}
+	mOwnedCpuDispatcher.reset();
+	mCpuDispatcher = nullptr;
+#if PX_SUPPORT_GPU_PHYSX
+	if ( mCudaContextManager != nullptr ) {
+		mCudaContextManager->release();
+		mCudaContextManager = nullptr;
+	}
+#endif
+	if ( mPhysics != nullptr ) {
+		mPhysics->release();
+		mPhysics = nullptr;
+	}
+	mSnapshots.clear();
+	if ( mFoundation != nullptr ) {
+		mFoundation->release();
+		mFoundation = nullptr;
+	}
+}
+
+mat3 Physx::from( const PxMat33& m )
+{
+	return mat3(
+		m.column0.x, m.column0.y, m.column0.z, 
+		m.column1.x, m.column1.y, m.column1.z, 
+		m.column2.x, m.column2.y, m.column2.z
+		);
+}
+
+mat4 Physx::from( const PxMat44& m )
+{
+	return mat4(
+		m.column0.x, m.column0.y, m.column0.z, m.column0.w, 
+		m.column1.x, m.column1.y, m.column1.z, m.column1.w,
+		m.column2.x, m.column2.y, m.column2.z, m.column2.w,
+		m.column3.x, m.column3.y, m.column3.z, m.column3.w
+		);
+}
+
+mat4 Physx::from( const PxTransform& t )
+{
+	return from( t.q, t.p );
+}
+
+mat4 Physx::from( const PxQuat& q, const PxVec3& v )
+{
+	return from( PxMat33( q ), v );
+}
+
+mat4 Physx::from( const PxMat33& m, const PxVec3& v )
+{
+	return mat4(
+		m.column0.x, m.column0.y, m.column0.z, 0.0f, 
+		m.column1.x, m.column1.y, m.column1.z, 0.0f, 
+		m.column2.x, m.column2.y, m.column2.z, 0.0f, 
+		v.x, v.y, v.z, 1.0f
+		);
+}
+
+quat Physx::from( const PxQuat& q )
+{
+	return quat( q.w, q.x, q.y, q.z );
+}
+
+vec2 Physx::from( const PxVec2& v )
+{
+	return vec2( v.x, v.y );
+}
+
+vec3 Physx::from( const PxVec3& v )
+{
+	return vec3( v.x, v.y, v.z );
+}
+
+vec4 Physx::from( const PxVec4& v )
+{
+	return vec4( v.x, v.y, v.z, v.w );
+}
+
+AxisAlignedBox Physx::from( const PxBounds3& b )
+{
+	return AxisAlignedBox( from( b.minimum ), from( b.maximum ) );
+}
+
+PxMat33 Physx::to( const mat3& m )
+{
+	return PxMat33( 
+		to( vec3( m[ 0 ] ) ), 
+		to( vec3( m[ 1 ] ) ), 
+		to( vec3( m[ 2 ] ) ) 
+		);
+}
+
+PxMat44 Physx::to( const mat4& m )
+{
+	return PxMat44(
+		to( vec4( m[ 0 ] ) ),
+		to( vec4( m[ 1 ] ) ),
+		to( vec4( m[ 2 ] ) ), 
+		to( vec4( m[ 3 ] ) )
+		);
+}
+
+PxQuat Physx::to( const quat& q )
+{
+	return PxQuat( q.x, q.y, q.z, q.w );
+}
+
+PxVec2 Physx::to( const vec2& v )
+{
+	return PxVec2( v.x, v.y );
+}
+
+PxVec3 Physx::to( const vec3& v )
+{
+	return PxVec3( v.x, v.y, v.z );
+}
+
+PxVec4 Physx::to( const vec4& v )
 {
 	return PxVec4( v.x, v.y, v.z, v.w );
 }
 
-PxTransform Physx::to( const quat& q, const vec3& v )
+PxTransform Physx::to( const quat& q, const vec3& v )
+{
+	return PxTransform( to( v ), to( q ) );
+}
+
+PxBounds3 Physx::to( const AxisAlignedBox& b )
+{
+	return PxBounds3( to( b.getMin() ), to( b.getMax() ) );
+}
+
+void Physx::from( const PxTransform* transforms, mat4* matrices, size_t count )
+{
+	toMatrices( transforms, nullptr, matrices, count );
+}
+
+void Physx::from( const PxTransform* transforms, const PxBounds3* bounds, mat4* matrices, size_t count )
+{
+	toMatrices( transforms, bounds, matrices, count );
+}
+
+void Physx::to( const mat4* matrices, PxTransform* transforms, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i ) {
+		transforms[ i ] = PxTransform( to( matrices[ i ] ) );
+	}
+}
+
+PxTransform Physx::interpolate( const PxTransform& a, const PxTransform& b, float alpha )
+{
+	// Normalized lerp along the shortest arc. Poses one step apart are 
+	// close enough that this is indistinguishable from a slerp.
+	PxQuat q	= b.q;
+	if ( a.q.dot( b.q ) < 0.0f ) {
+		q		= PxQuat( -q.x, -q.y, -q.z, -q.w );
+	}
+	float t		= 1.0f - alpha;
+	q			= PxQuat(
+		a.q.x * t + q.x * alpha, 
+		a.q.y * t + q.y * alpha, 
+		a.q.z * t + q.z * alpha, 
+		a.q.w * t + q.w * alpha 
+		).getNormalized();
+	return PxTransform( a.p * t + b.p * alpha, q );
+}
+
+PxAllocatorCallback& Physx::getAllocator() const
+{
+	return *mAllocator;
+}
+
+Physx::PoolAllocator* Physx::getPoolAllocator() const
+{
+	return mPoolAllocator;
+}
+
+const vector<PxActiveTransform>& Physx::getBufferedActiveTransforms( uint32_t sceneId ) const
+{
+	static const vector<PxActiveTransform> empty;
+	map<uint32_t, SceneInfo>::const_iterator iter = mSceneInfo.find( sceneId );
+	return iter != mSceneInfo.end() ? iter->second.mActiveTransforms : empty;
+}
+
+PxCooking* Physx::getCooking() const
+{
+	return mCooking;
+}
+
+PxCpuDispatcher* Physx::getCpuDispatcher() const
+{
+	return mCpuDispatcher;
+}
+
+#if PX_SUPPORT_GPU_PHYSX
+PxCudaContextManager* Physx::getCudaContextManager() const
+{
+	return mCudaContextManager;
+}
+#endif
+
+PxFoundation* Physx::getFoundation() const
+{
+	return mFoundation;
+}
+
+PxPhysics* Physx::getPhysics() const
+{
+	return mPhysics;
+}
+
+PxProfileZoneManager* Physx::getProfileZoneManager() const
+{
+	return mProfileZoneManager;
+}
+
+#if !defined( CINDER_COCOA_TOUCH )
+PvdConnection* Physx::getPvdConnection() const
+{
+	return mPvdConnection;
+}
+#endif
+
+void Physx::beginUpdate( float deltaInSeconds )
+{
+	// Finish any step still in flight before touching actors. The 
+	// update is recorded after that and after queued commands, so a 
+	// replayed step starts from the same actors the live one did.
+	endUpdate();
+	applyCommands();
+	if ( mRecorder ) {
+		mRecorder->writeOpcode( RECORD_UPDATE );
+		mRecorder->write( deltaInSeconds );
+	}
+
+	if ( mPoolAllocator != nullptr ) {
+		mPoolAllocator->nextFrame();
+	}
+
+	for ( auto& iter : mSceneInfo ) {
+		iter.second.mActiveTransforms.clear();
+		iter.second.mNumSteps = 0;
+	}
+
+	if ( !isFixedTimestepEnabled() ) {
+		beginStep( deltaInSeconds );
+		return;
+	}
+
+	// Drop whatever time we can't catch up on within the substep 
+	// budget rather than falling further behind every frame
+	mAccumulator		+= deltaInSeconds;
+	uint32_t numSteps	= (uint32_t)( mAccumulator / mFixedTimestep );
+	if ( numSteps > mMaxSubsteps ) {
+		numSteps		= mMaxSubsteps;
+		mAccumulator	= mFixedTimestep * (float)numSteps;
+	}
+	mAccumulator		-= mFixedTimestep * (float)numSteps;
+	if ( numSteps == 0 ) {
+		return;
+	}
+
+	// All but the last substep run to completion here. The last one 
+	// is left in flight like a regular variable step.
+	for ( uint32_t i = 1; i < numSteps; ++i ) {
+		beginStep( mFixedTimestep );
+		waitForScenes();
+	}
+
+	for ( size_t i = 0; i < mActors.size(); ++i ) {
+		if ( mActors[ i ].second->getType() == PxActorType::eRIGID_DYNAMIC ) {
+			mPreviousPoses[ i ] = static_cast<PxRigidDynamic*>( mActors[ i ].second )->getGlobalPose();
+		}
+	}
+	beginStep( mFixedTimestep );
+}
+
+void Physx::endUpdate()
+{
+	waitForScenes();
+	finishStats();
+}
+
+bool Physx::isUpdateComplete() const
+{
+	for ( PxScene* scene : mSimulatingScenes ) {
+		if ( !scene->checkResults( false ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Physx::isUpdating() const
+{
+	return !mSimulatingScenes.empty();
+}
+
+void Physx::update( float deltaInSeconds )
+{
+	beginUpdate( deltaInSeconds );
+	endUpdate();
+}
+
+size_t Physx::drainContactEvents( vector<ContactEvent>& events )
+{
+	size_t count = events.size();
+	for ( auto& iter : mSceneInfo ) {
+		if ( iter.second.mEventCallback ) {
+			iter.second.mEventCallback->mContacts.drain( events );
+		}
+	}
+	return events.size() - count;
+}
+
+size_t Physx::drainSleepEvents( vector<SleepEvent>& events )
+{
+	size_t count = events.size();
+	for ( auto& iter : mSceneInfo ) {
+		if ( iter.second.mEventCallback ) {
+			iter.second.mEventCallback->mSleeps.drain( events );
+		}
+	}
+	return events.size() - count;
+}
+
+size_t Physx::drainTriggerEvents( vector<TriggerEvent>& events )
+{
+	size_t count = events.size();
+	for ( auto& iter : mSceneInfo ) {
+		if ( iter.second.mEventCallback ) {
+			iter.second.mEventCallback->mTriggers.drain( events );
+		}
+	}
+	return events.size() - count;
+}
+
+const PxSimulationStatistics& Physx::getSimulationStatistics( uint32_t sceneId ) const
+{
+	static const PxSimulationStatistics kEmpty = PxSimulationStatistics();
+	map<uint32_t, SceneInfo>::const_iterator iter = mSceneInfo.find( sceneId );
+	return iter == mSceneInfo.end() ? kEmpty : iter->second.mStatistics;
+}
+
+const Physx::TimingHistory& Physx::getStepHistory( StepTimer timer ) const
+{
+	CI_ASSERT( timer < STEP_TIMER_COUNT );
+	return mStepHistory[ timer ];
+}
+
+const Physx::StepStats& Physx::getStepStats() const
+{
+	return mStepStats;
+}
+
+size_t Physx::getNumDroppedEvents() const
+{
+	size_t count = 0;
+	for ( const auto& iter : mSceneInfo ) {
+		if ( iter.second.mEventCallback ) {
+			count += iter.second.mEventCallback->mNumDropped;
+		}
+	}
+	return count;
+}
+
+void Physx::disableFixedTimestep()
+{
+	mAccumulator	= 0.0f;
+	mFixedTimestep	= 0.0f;
+	mMaxSubsteps	= 1;
+	if ( mRecorder ) {
+		mRecorder->writeOpcode( RECORD_DISABLE_FIXED_TIMESTEP );
+	}
+}
+
+void Physx::enableFixedTimestep( float stepInSeconds, uint32_t maxSubsteps )
+{
+	CI_ASSERT( stepInSeconds > 0.0f );
+
+	// Poses aren't tracked while variable stepping, so start 
+	// interpolating from where actors are now
+	if ( !isFixedTimestepEnabled() ) {
+		for ( size_t i = 0; i < mActors.size(); ++i ) {
+			PxActor* actor = mActors[ i ].second;
+			if ( actor->getType() == PxActorType::eRIGID_DYNAMIC || 
+				 actor->getType() == PxActorType::eRIGID_STATIC ) {
+				mPreviousPoses[ i ] = static_cast<PxRigidActor*>( actor )->getGlobalPose();
+			}
+		}
+	}
+	mFixedTimestep	= stepInSeconds;
+	mMaxSubsteps	= max<uint32_t>( maxSubsteps, 1 );
+	if ( mRecorder ) {
+		mRecorder->writeOpcode( RECORD_ENABLE_FIXED_TIMESTEP );
+		mRecorder->write( mFixedTimestep );
+		mRecorder->write( mMaxSubsteps );
+	}
+}
+
+float Physx::getFixedTimestep() const
+{
+	return mFixedTimestep;
+}
+
+float Physx::getInterpolationAlpha() const
+{
+	return isFixedTimestepEnabled() ? mAccumulator / mFixedTimestep : 1.0f;
+}
+
+PxTransform Physx::getInterpolatedPose( uint32_t id ) const
+{
+	PxActor* actor = getActor( id );
+	if ( actor == nullptr || 
+		( actor->getType() != PxActorType::eRIGID_DYNAMIC && 
+		  actor->getType() != PxActorType::eRIGID_STATIC ) ) {
+		return PxTransform( PxIdentity );
+	}
+	return getInterpolatedPose( *static_cast<PxRigidActor*>( actor ) );
+}
+
+PxTransform Physx::getInterpolatedPose( const PxRigidActor& actor ) const
+{
+	PxTransform pose = actor.getGlobalPose();
+	if ( isFixedTimestepEnabled() ) {
+		uintptr_t id	= (uintptr_t)actor.userData;
+		size_t index	= findActor( (uint32_t)id );
+		if ( index != kActorInvalid ) {
+			return interpolate( mPreviousPoses[ index ], pose, getInterpolationAlpha() );
+		}
+	}
+	return pose;
+}
+
+void Physx::getInstances( InstanceBuckets& buckets ) const
+{
+	float alpha			= getInterpolationAlpha();
+	bool interpolated	= isFixedTimestepEnabled();
+	if ( buckets.mSource != this || buckets.mInterpolated != interpolated ) {
+		buckets.clear();
+	}
+
+	// Membership is only revisited after actors have been added, 
+	// erased or cleared since the last call
+	if ( buckets.mSource != this || buckets.mNumActorChanges != mNumActorChanges ) {
+		vector<uint32_t> stale;
+		for ( const auto& iter : buckets.mLocations ) {
+			size_t index = findActor( iter.first );
+			if ( index == kActorInvalid || index < mNumClearedActors || 
+				mActorSlots[ iter.first & kActorIndexMask ].mErased ) {
+				stale.push_back( iter.first );
+			}
+		}
+		for ( uint32_t id : stale ) {
+			buckets.erase( id );
+		}
+
+		for ( size_t i = mNumClearedActors; i < mActors.size(); ++i ) {
+			PxActor* actor = mActors[ i ].second;
+			if ( mActorSlots[ mActors[ i ].first & kActorIndexMask ].mErased || 
+				( actor->getType() != PxActorType::eRIGID_DYNAMIC && 
+				  actor->getType() != PxActorType::eRIGID_STATIC ) || 
+				buckets.contains( mActors[ i ].first ) ) {
+				continue;
+			}
+			const PxRigidActor& rigidActor	= *static_cast<PxRigidActor*>( actor );
+			PxTransform pose				= rigidActor.getGlobalPose();
+			if ( interpolated ) {
+				pose = interpolate( mPreviousPoses[ i ], pose, alpha );
+			}
+			buckets.add( rigidActor, pose );
+		}
+		buckets.mInterpolated		= interpolated;
+		buckets.mNumActorChanges	= mNumActorChanges;
+		buckets.mSource				= this;
+	}
+
+	// Only actors that moved in the last update need new poses. 
+	// Interpolated poses keep moving until the next step, so those 
+	// actors are remembered and refreshed every call until then.
+	bool stepped = false;
+	for ( const auto& iter : mSceneInfo ) {
+		stepped = stepped || iter.second.mNumSteps > 0;
+	}
+	if ( !interpolated ) {
+		for ( const auto& iter : mSceneInfo ) {
+			for ( const PxActiveTransform& transform : iter.second.mActiveTransforms ) {
+				uintptr_t id = (uintptr_t)transform.userData;
+				buckets.setPose( (uint32_t)id, transform.actor2World );
+			}
+		}
+		return;
+	}
+
+	if ( stepped ) {
+		buckets.mMovingIds.clear();
+		for ( const auto& iter : mSceneInfo ) {
+			for ( const PxActiveTransform& transform : iter.second.mActiveTransforms ) {
+				uintptr_t id = (uintptr_t)transform.userData;
+				buckets.mMovingIds.push_back( (uint32_t)id );
+			}
+		}
+	}
+	for ( uint32_t id : buckets.mMovingIds ) {
+		size_t index = findActor( id );
+		if ( index == kActorInvalid || index < mNumClearedActors || 
+			mActorSlots[ id & kActorIndexMask ].mErased || 
+			mActors[ index ].second->getType() != PxActorType::eRIGID_DYNAMIC ) {
+			continue;
+		}
+		PxTransform pose = static_cast<PxRigidDynamic*>( mActors[ index ].second )->getGlobalPose();
+		buckets.setPose( id, interpolate( mPreviousPoses[ index ], pose, alpha ) );
+	}
+}
+
+uint32_t Physx::getMaxSubsteps() const
+{
+	return mMaxSubsteps;
+}
+
+bool Physx::isFixedTimestepEnabled() const
+{
+	return mFixedTimestep > 0.0f;
+}
+
+bool Physx::isRecording() const
+{
+	return mRecorder != nullptr;
+}
+
+// Opens with the current world so playback can start from scratch
+bool Physx::startRecording( const fs::path& path )
+{
+	stopRecording();
+	unique_ptr<Recorder> recorder( new Recorder( path ) );
+	if ( !recorder->isValid() ) {
+		CI_LOG_E( "Unable to open " << path << " for recording" );
+		return false;
+	}
+
+	recorder->writeOpcode( RECORD_FILTER_SHADER_DATA );
+	recorder->write( mFilterShaderData );
+	if ( isFixedTimestepEnabled() ) {
+		recorder->writeOpcode( RECORD_ENABLE_FIXED_TIMESTEP );
+		recorder->write( mFixedTimestep );
+		recorder->write( mMaxSubsteps );
+	}
+	for ( const auto& iter : mScenes ) {
+		const SceneInfo& info = mSceneInfo[ iter.first ];
+		recorder->writeScene( iter.first, *iter.second );
+		recorder->writeOpcode( RECORD_SCENE_ENABLED );
+		recorder->write( iter.first );
+		recorder->write( (uint8_t)( info.mEnabled ? 1 : 0 ) );
+		recorder->writeOpcode( RECORD_SCENE_PRIORITY );
+		recorder->write( iter.first );
+		recorder->write( info.mPriority );
+	}
+	for ( size_t i = mNumClearedActors; i < mActors.size(); ++i ) {
+		const pair<uint32_t, PxActor*>& iter = mActors[ i ];
+		PxScene* scene = iter.second->getScene();
+		if ( !mActorSlots[ iter.first & kActorIndexMask ].mErased && scene != nullptr ) {
+			uintptr_t sceneId = (uintptr_t)scene->userData;
+			recorder->writeActor( (uint32_t)sceneId, iter.first, *iter.second );
+		}
+	}
+	mRecorder = move( recorder );
+	return true;
+}
+
+void Physx::stopRecording()
+{
+	mRecorder.reset();
+}
+
+uint32_t Physx::addActor( PxActor* actor, uint32_t sceneId )
+{
+	return addActor( actor, getScene( sceneId ) );
+}
+
+uint32_t Physx::addActor( PxActor* actor, PxScene* scene )
+{
+	if ( scene == nullptr ) {
+		return kInvalidId;
+	}
+	uint32_t id = acquireActorId( actor );
+	if ( id == kInvalidId ) {
+		return kInvalidId;
+	}
+	scene->addActor( *actor );
+	if ( mRecorder ) {
+		uintptr_t sceneId = (uintptr_t)scene->userData;
+		mRecorder->writeActor( (uint32_t)sceneId, id, *actor );
+	}
+	return id;
+}
+
+void Physx::addActors( PxActor* const* actors, uint32_t count, uint32_t sceneId, uint32_t* ids )
+{
+	addActors( actors, count, getScene( sceneId ), ids );
+}
+
+void Physx::addActors( PxActor* const* actors, uint32_t count, PxScene* scene, uint32_t* ids )
+{
+	if ( count == 0 ) {
+		return;
+	}
+	// Actors that don't get an ID are left with the caller
+	if ( scene == nullptr ) {
+		if ( ids != nullptr ) {
+			fill( ids, ids + count, kInvalidId );
+		}
+		return;
+	}
+	mActors.reserve( mActors.size() + count );
+	mPreviousPoses.reserve( mPreviousPoses.size() + count );
+	if ( mFreeActorSlots.size() < count ) {
+		mActorSlots.reserve( mActorSlots.size() + count - mFreeActorSlots.size() );
+	}
+	bool rejected = false;
+	vector<PxActor*> accepted;
+	for ( uint32_t i = 0; i < count; ++i ) {
+		uint32_t id = acquireActorId( actors[ i ] );
+		if ( ids != nullptr ) {
+			ids[ i ] = id;
+		}
+		if ( id == kInvalidId ) {
+			if ( !rejected ) {
+				accepted.assign( actors, actors + i );
+				rejected = true;
+			}
+			continue;
+		}
+		if ( rejected ) {
+			accepted.push_back( actors[ i ] );
+		}
+		if ( mRecorder ) {
+			uintptr_t sceneId = (uintptr_t)scene->userData;
+			mRecorder->writeActor( (uint32_t)sceneId, id, *actors[ i ] );
+		}
+	}
+
+	if ( rejected ) {
+		if ( accepted.empty() ) {
+			return;
+		}
+		actors	= &accepted[ 0 ];
+		count	= (uint32_t)accepted.size();
+	}
+
+	// PhysX only accepts batched insertion between steps. Single 
+	// insertions are buffered while the scene is simulating.
+	if ( isSimulating( scene ) ) {
+		for ( uint32_t i = 0; i < count; ++i ) {
+			scene->addActor( *actors[ i ] );
+		}
+	} else {
+		scene->addActors( actors, count );
+	}
+}
+
+vector<uint32_t> Physx::addActors( const vector<PxActor*>& actors, uint32_t sceneId )
+{
+	return addActors( actors, getScene( sceneId ) );
+}
+
+vector<uint32_t> Physx::addActors( const vector<PxActor*>& actors, PxScene* scene )
+{
+	vector<uint32_t> ids( actors.size() );
+	if ( !actors.empty() ) {
+		addActors( &actors[ 0 ], (uint32_t)actors.size(), scene, &ids[ 0 ] );
+	}
+	return ids;
+}
+
+void Physx::clearActors()
+{
+	// Actors are only ever appended between flushes, so everything 
+	// registered right now is the front of the array
+	mNumClearedActors = mActors.size();
+	++mNumActorChanges;
+	if ( mRecorder ) {
+		mRecorder->writeOpcode( RECORD_CLEAR_ACTORS );
+	}
+}
+
+void Physx::eraseActor( uint32_t id )
+{
+	size_t index = findActor( id );
+	if ( index != kActorInvalid && index >= mNumClearedActors ) {
+		ActorSlot& actorSlot = mActorSlots[ id & kActorIndexMask ];
+		if ( !actorSlot.mErased ) {
+			actorSlot.mErased = true;
+			mDeletedActors.push_back( id );
+			++mNumActorChanges;
+			if ( mRecorder ) {
+				mRecorder->writeOpcode( RECORD_ERASE_ACTOR );
+				mRecorder->write( id );
+			}
+		}
+	}
+}
+
+void Physx::eraseActor( PxActor& actor )
+{
+	uintptr_t id = (uintptr_t)actor.userData;
+	eraseActor( (uint32_t)id );
+}
+
+void Physx::eraseActor( PxActor* actor )
+{
+	uintptr_t id = (uintptr_t)actor->userData;
+	eraseActor( (uint32_t)id );
+}
+
+PxActor* Physx::getActor( uint32_t id ) const
+{
+	size_t index = findActor( id );
+	return index != kActorInvalid ? mActors[ index ].second : nullptr;
+}
+
+const vector<pair<uint32_t, PxActor*>>& Physx::getActors() const
+{
+	return mActors;
+}
+
+void Physx::addForce( uint32_t id, const vec3& force, PxForceMode::Enum mode )
+{
+	PxRigidDynamic* body = getRigidDynamic( id );
+	if ( body != nullptr ) {
+		body->addForce( to( force ), mode );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_ADD_FORCE );
+			mRecorder->write( id );
+			mRecorder->write( to( force ) );
+			mRecorder->write( (uint8_t)mode );
+		}
+	}
+}
+
+void Physx::addTorque( uint32_t id, const vec3& torque, PxForceMode::Enum mode )
+{
+	PxRigidDynamic* body = getRigidDynamic( id );
+	if ( body != nullptr ) {
+		body->addTorque( to( torque ), mode );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_ADD_TORQUE );
+			mRecorder->write( id );
+			mRecorder->write( to( torque ) );
+			mRecorder->write( (uint8_t)mode );
+		}
+	}
+}
+
+void Physx::setAngularVelocity( uint32_t id, const vec3& velocity )
+{
+	PxRigidDynamic* body = getRigidDynamic( id );
+	if ( body != nullptr ) {
+		body->setAngularVelocity( to( velocity ) );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SET_ANGULAR_VELOCITY );
+			mRecorder->write( id );
+			mRecorder->write( to( velocity ) );
+		}
+	}
+}
+
+void Physx::setGlobalPose( uint32_t id, const PxTransform& pose )
+{
+	PxActor* actor = getActor( id );
+	if ( actor != nullptr && ( actor->getType() == PxActorType::eRIGID_DYNAMIC || 
+							   actor->getType() == PxActorType::eRIGID_STATIC ) ) {
+		static_cast<PxRigidActor*>( actor )->setGlobalPose( pose );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SET_GLOBAL_POSE );
+			mRecorder->write( id );
+			mRecorder->write( pose );
+		}
+	}
+}
+
+void Physx::setKinematicTarget( uint32_t id, const PxTransform& pose )
+{
+	PxRigidDynamic* body = getRigidDynamic( id );
+	if ( body != nullptr ) {
+		body->setKinematicTarget( pose );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SET_KINEMATIC_TARGET );
+			mRecorder->write( id );
+			mRecorder->write( pose );
+		}
+	}
+}
+
+void Physx::setLinearVelocity( uint32_t id, const vec3& velocity )
+{
+	PxRigidDynamic* body = getRigidDynamic( id );
+	if ( body != nullptr ) {
+		body->setLinearVelocity( to( velocity ) );
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SET_LINEAR_VELOCITY );
+			mRecorder->write( id );
+			mRecorder->write( to( velocity ) );
+		}
+	}
+}
+
+uint32_t Physx::queueAddActor( PxActor* actor, uint32_t sceneId )
+{
+	uint32_t id = kInvalidId;
+	if ( !mCommandQueue || actor == nullptr || !mCommandQueue->mIds.pop( id ) ) {
+		return kInvalidId;
+	}
+
+	Command command;
+	command.mActor		= actor;
+	command.mId			= id;
+	command.mSceneId	= sceneId;
+	command.mType		= COMMAND_ADD_ACTOR;
+	if ( !mCommandQueue->mCommands.push( command ) ) {
+		// Always fits eventually; a cell may still be mid-pop
+		while ( !mCommandQueue->mIds.push( id ) ) {
+			this_thread::yield();
+		}
+		return kInvalidId;
+	}
+	return id;
+}
+
+bool Physx::queueEraseActor( uint32_t id )
+{
+	Command command;
+	command.mId		= id;
+	command.mType	= COMMAND_ERASE_ACTOR;
+	return mCommandQueue && mCommandQueue->mCommands.push( command );
+}
+
+bool Physx::queueSetAngularVelocity( uint32_t id, const vec3& velocity )
+{
+	Command command;
+	command.mId			= id;
+	command.mType		= COMMAND_SET_ANGULAR_VELOCITY;
+	command.mVelocity	= velocity;
+	return mCommandQueue && mCommandQueue->mCommands.push( command );
+}
+
+bool Physx::queueSetGlobalPose( uint32_t id, const PxTransform& pose )
+{
+	Command command;
+	command.mId		= id;
+	command.mPose	= pose;
+	command.mType	= COMMAND_SET_GLOBAL_POSE;
+	return mCommandQueue && mCommandQueue->mCommands.push( command );
+}
+
+bool Physx::queueSetKinematicTarget( uint32_t id, const PxTransform& pose )
+{
+	Command command;
+	command.mId		= id;
+	command.mPose	= pose;
+	command.mType	= COMMAND_SET_KINEMATIC_TARGET;
+	return mCommandQueue && mCommandQueue->mCommands.push( command );
+}
+
+bool Physx::queueSetLinearVelocity( uint32_t id, const vec3& velocity )
+{
+	Command command;
+	command.mId			= id;
+	command.mType		= COMMAND_SET_LINEAR_VELOCITY;
+	command.mVelocity	= velocity;
+	return mCommandQueue && mCommandQueue->mCommands.push( command );
+}
+
+Physx::GeometryKey::GeometryKey( const PxGeometry& geometry )
+: mFlags( 0 ), mMesh( nullptr ), mType( (uint32_t)geometry.getType() )
+{
+	fill( mValues, mValues + 7, 0.0f );
+	const PxMeshScale* scale = nullptr;
+	switch ( geometry.getType() ) {
+	case PxGeometryType::eBOX:
+		{
+			const PxVec3& halfExtents = static_cast<const PxBoxGeometry&>( geometry ).halfExtents;
+			mValues[ 0 ] = halfExtents.x;
+			mValues[ 1 ] = halfExtents.y;
+			mValues[ 2 ] = halfExtents.z;
+		}
+		break;
+	case PxGeometryType::eCAPSULE:
+		mValues[ 0 ] = static_cast<const PxCapsuleGeometry&>( geometry ).radius;
+		mValues[ 1 ] = static_cast<const PxCapsuleGeometry&>( geometry ).halfHeight;
+		break;
+	case PxGeometryType::eCONVEXMESH:
+		mMesh	= static_cast<const PxConvexMeshGeometry&>( geometry ).convexMesh;
+		scale	= &static_cast<const PxConvexMeshGeometry&>( geometry ).scale;
+		break;
+	case PxGeometryType::eHEIGHTFIELD:
+		{
+			const PxHeightFieldGeometry& heightField = static_cast<const PxHeightFieldGeometry&>( geometry );
+			mFlags			= (PxU8)heightField.heightFieldFlags;
+			mMesh			= heightField.heightField;
+			mValues[ 0 ]	= heightField.heightScale;
+			mValues[ 1 ]	= heightField.rowScale;
+			mValues[ 2 ]	= heightField.columnScale;
+		}
+		break;
+	case PxGeometryType::eSPHERE:
+		mValues[ 0 ] = static_cast<const PxSphereGeometry&>( geometry ).radius;
+		break;
+	case PxGeometryType::eTRIANGLEMESH:
+		mFlags	= (PxU8)static_cast<const PxTriangleMeshGeometry&>( geometry ).meshFlags;
+		mMesh	= static_cast<const PxTriangleMeshGeometry&>( geometry ).triangleMesh;
+		scale	= &static_cast<const PxTriangleMeshGeometry&>( geometry ).scale;
+		break;
+	default:
+		break;
+	}
+	if ( scale != nullptr ) {
+		mValues[ 0 ] = scale->scale.x;
+		mValues[ 1 ] = scale->scale.y;
+		mValues[ 2 ] = scale->scale.z;
+		mValues[ 3 ] = scale->rotation.x;
+		mValues[ 4 ] = scale->rotation.y;
+		mValues[ 5 ] = scale->rotation.z;
+		mValues[ 6 ] = scale->rotation.w;
+	}
+}
+
+bool Physx::GeometryKey::operator<( const GeometryKey& rhs ) const
+{
+	if ( mType != rhs.mType ) {
+		return mType < rhs.mType;
+	}
+	if ( mMesh != rhs.mMesh ) {
+		return less<const void*>()( mMesh, rhs.mMesh );
+	}
+	if ( mFlags != rhs.mFlags ) {
+		return mFlags < rhs.mFlags;
+	}
+	return lexicographical_compare( mValues, mValues + 7, rhs.mValues, rhs.mValues + 7 );
+}
+
+Physx::ActorPoolKey::ActorPoolKey( const PxGeometry& geometry, const PxMaterial* material, float density )
+: mDensity( density ), mGeometry( geometry ), mMaterial( material )
+{
+}
+
+bool Physx::ActorPoolKey::operator<( const ActorPoolKey& rhs ) const
+{
+	if ( mMaterial != rhs.mMaterial ) {
+		return less<const PxMaterial*>()( mMaterial, rhs.mMaterial );
+	}
+	if ( mDensity != rhs.mDensity ) {
+		return mDensity < rhs.mDensity;
+	}
+	return mGeometry < rhs.mGeometry;
+}
+
+Physx::ActorState::ActorState()
+: mAngularDamping( 0.0f ), mCenterOfMass( PxIdentity ), mDominanceGroup( 0 ), mInertia( 0.0f ), mLinearDamping( 0.0f ), 
+mMass( 0.0f ), mMaxAngularVelocity( 0.0f ), mMinPositionIters( 0 ), mMinVelocityIters( 0 ), mSleepThreshold( 0.0f )
+{
+}
+
+Physx::ActorState::ActorState( const PxRigidDynamic& actor )
+: mActorFlags( actor.getActorFlags() ), mAngularDamping( actor.getAngularDamping() ), 
+mCenterOfMass( actor.getCMassLocalPose() ), mDominanceGroup( actor.getDominanceGroup() ), 
+mInertia( actor.getMassSpaceInertiaTensor() ), mLinearDamping( actor.getLinearDamping() ), mMass( actor.getMass() ), 
+mMaxAngularVelocity( actor.getMaxAngularVelocity() ), mSleepThreshold( actor.getSleepThreshold() )
+{
+	actor.getSolverIterationCounts( mMinPositionIters, mMinVelocityIters );
+}
+
+void Physx::ActorState::apply( PxRigidDynamic& actor ) const
+{
+	actor.setActorFlags( mActorFlags );
+	actor.setAngularDamping( mAngularDamping );
+	actor.setCMassLocalPose( mCenterOfMass );
+	actor.setDominanceGroup( mDominanceGroup );
+	actor.setLinearDamping( mLinearDamping );
+	actor.setMass( mMass );
+	actor.setMassSpaceInertiaTensor( mInertia );
+	actor.setMaxAngularVelocity( mMaxAngularVelocity );
+	actor.setRigidBodyFlags( PxRigidBodyFlags() );
+	actor.setSleepThreshold( mSleepThreshold );
+	actor.setSolverIterationCounts( mMinPositionIters, mMinVelocityIters );
+}
+
+Physx::MaterialKey::MaterialKey( float staticFriction, float dynamicFriction, float restitution )
+: mDynamicFriction( dynamicFriction ), mRestitution( restitution ), mStaticFriction( staticFriction )
+{
+}
+
+bool Physx::MaterialKey::operator<( const MaterialKey& rhs ) const
+{
+	if ( mStaticFriction != rhs.mStaticFriction ) {
+		return mStaticFriction < rhs.mStaticFriction;
+	}
+	if ( mDynamicFriction != rhs.mDynamicFriction ) {
+		return mDynamicFriction < rhs.mDynamicFriction;
+	}
+	return mRestitution < rhs.mRestitution;
+}
+
+Physx::MaterialRef::MaterialRef( const MaterialKey& key )
+: mKey( key ), mNumUsers( 0 )
+{
+}
+
+Physx::ShapeKey::ShapeKey( const PxGeometry& geometry, const PxMaterial* material, const PxFilterData& filterData, 
+						   PxShapeFlags flags )
+: mFilterData( filterData ), mFlags( flags ), mGeometry( geometry ), mMaterial( material )
+{
+}
+
+bool Physx::ShapeKey::operator<( const ShapeKey& rhs ) const
+{
+	if ( mMaterial != rhs.mMaterial ) {
+		return less<const PxMaterial*>()( mMaterial, rhs.mMaterial );
+	}
+	if ( (PxU8)mFlags != (PxU8)rhs.mFlags ) {
+		return (PxU8)mFlags < (PxU8)rhs.mFlags;
+	}
+	const PxU32 a[] = { mFilterData.word0, mFilterData.word1, mFilterData.word2, mFilterData.word3 };
+	const PxU32 b[] = { rhs.mFilterData.word0, rhs.mFilterData.word1, rhs.mFilterData.word2, rhs.mFilterData.word3 };
+	if ( !equal( a, a + 4, b ) ) {
+		return lexicographical_compare( a, a + 4, b, b + 4 );
+	}
+	return mGeometry < rhs.mGeometry;
+}
+
+Physx::ShapeRef::ShapeRef( const ShapeKey& key )
+: mKey( key ), mNumActors( 0 )
+{
+}
+
+Physx::ActorPool::ActorPool()
+: mShape( nullptr )
+{
+}
+
+void Physx::clearActorPool()
+{
+	for ( auto& iter : mActorPool ) {
+		for ( PxRigidDynamic* actor : iter.second.mActors ) {
+			mActorPoolKeys.erase( actor );
+			actor->release();
+		}
+		releaseCachedShape( iter.second.mShape );
+	}
+	mActorPool.clear();
+}
+
+PxRigidDynamic* Physx::createPooledActor( const PxGeometry& geometry, PxMaterial& material, const PxTransform& pose, 
+										  float density, const vec3& linearVelocity, const vec3& angularVelocity )
+{
+	if ( !isPoolable( geometry ) ) {
+		CI_LOG_E( "Only box, capsule, convex mesh and sphere actors can be pooled" );
+		return nullptr;
+	}
+	PxShape* shape = getShape( geometry, material );
+	if ( shape == nullptr ) {
+		return nullptr;
+	}
+
+	ActorPoolKey key( geometry, &material, density );
+	ActorPool& pool			= getActorPool( key, shape );
+	PxRigidDynamic* actor	= nullptr;
+	if ( !pool.mActors.empty() ) {
+		actor = pool.mActors.back();
+		pool.mActors.pop_back();
+
+		// Undo anything the last owner may have changed. A shape that 
+		// was swapped, e.g. by setFilterData(), goes back to the plain one.
+		PxShape* current = nullptr;
+		if ( actor->getShapes( &current, 1 ) == 1 && current != shape ) {
+			actor->attachShape( *shape );
+			actor->detachShape( *current );
+		}
+		pool.mState.apply( *actor );
+		actor->clearForce();
+		actor->clearTorque();
+		actor->setGlobalPose( pose );
+	} else {
+		actor = PxCreateDynamic( *mPhysics, pose, *shape, density );
+		if ( actor == nullptr ) {
+			return nullptr;
+		}
+		if ( pool.mState.mMass == 0.0f ) {
+			pool.mState = ActorState( *actor );
+		}
+		mActorPoolKeys.insert( make_pair( actor, key ) );
+	}
+	actor->setLinearVelocity( to( linearVelocity ) );
+	actor->setAngularVelocity( to( angularVelocity ) );
+	actor->setWakeCounter( kActorWakeCounter );
+	return actor;
+}
+
+Physx::ActorPool& Physx::getActorPool( const ActorPoolKey& key, PxShape* shape )
+{
+	map<ActorPoolKey, ActorPool>::iterator iter = mActorPool.find( key );
+	if ( iter == mActorPool.end() ) {
+		iter				= mActorPool.insert( make_pair( key, ActorPool() ) ).first;
+		iter->second.mShape	= shape;
+		++mShapeRefs.find( shape )->second.mNumActors;
+	}
+	return iter->second;
+}
+
+size_t Physx::getNumPooledActors() const
+{
+	size_t count = 0;
+	for ( const auto& iter : mActorPool ) {
+		count += iter.second.mActors.size();
+	}
+	return count;
+}
+
+void Physx::reserveActorPool( const PxGeometry& geometry, PxMaterial& material, size_t count, float density )
+{
+	if ( !isPoolable( geometry ) ) {
+		return;
+	}
+	PxShape* shape = getShape( geometry, material );
+	if ( shape == nullptr ) {
+		return;
+	}
+	ActorPoolKey key( geometry, &material, density );
+	ActorPool& pool = getActorPool( key, shape );
+	pool.mActors.reserve( count );
+	while ( pool.mActors.size() < count ) {
+		PxRigidDynamic* actor = PxCreateDynamic( *mPhysics, PxTransform( PxIdentity ), *shape, density );
+		if ( actor == nullptr ) {
+			break;
+		}
+		if ( pool.mState.mMass == 0.0f ) {
+			pool.mState = ActorState( *actor );
+		}
+		mActorPoolKeys.insert( make_pair( actor, key ) );
+		pool.mActors.push_back( actor );
+	}
+}
+
+PxMaterial* Physx::getMaterial( float staticFriction, float dynamicFriction, float restitution )
+{
+	MaterialKey key( staticFriction, dynamicFriction, restitution );
+	map<MaterialKey, PxMaterial*>::iterator iter = mMaterialCache.find( key );
+	if ( iter != mMaterialCache.end() ) {
+		return iter->second;
+	}
+	PxMaterial* material = mPhysics->createMaterial( staticFriction, dynamicFriction, restitution );
+	if ( material != nullptr ) {
+		mMaterialCache.insert( make_pair( key, material ) );
+		mMaterialRefs.insert( make_pair( material, MaterialRef( key ) ) );
+	}
+	return material;
+}
+
+size_t Physx::getNumCachedMaterials() const
+{
+	return mMaterialCache.size();
+}
+
+size_t Physx::getNumCachedShapes() const
+{
+	return mShapeCache.size();
+}
+
+PxShape* Physx::getShape( const PxGeometry& geometry, PxMaterial& material, const PxFilterData& filterData, 
+						  PxShapeFlags flags )
+{
+	ShapeKey key( geometry, &material, filterData, flags );
+	map<ShapeKey, PxShape*>::iterator iter = mShapeCache.find( key );
+	if ( iter != mShapeCache.end() ) {
+		return iter->second;
+	}
+	PxShape* shape = mPhysics->createShape( geometry, material, false, flags );
+	if ( shape == nullptr ) {
+		return nullptr;
+	}
+	shape->setSimulationFilterData( filterData );
+	mShapeCache.insert( make_pair( key, shape ) );
+	mShapeRefs.insert( make_pair( shape, ShapeRef( key ) ) );
+	updateMaterialRefs( shape, true );
+	return shape;
+}
+
+void Physx::trimMaterialCache()
+{
+	for ( map<const PxMaterial*, MaterialRef>::iterator iter = mMaterialRefs.begin(); iter != mMaterialRefs.end(); ) {
+		if ( iter->second.mNumUsers == 0 ) {
+			mMaterialCache[ iter->second.mKey ]->release();
+			mMaterialCache.erase( iter->second.mKey );
+			iter = mMaterialRefs.erase( iter );
+		} else {
+			++iter;
+		}
+	}
+}
+
+void Physx::trimShapeCache()
+{
+	for ( map<const PxShape*, ShapeRef>::iterator iter = mShapeRefs.begin(); iter != mShapeRefs.end(); ) {
+		if ( iter->second.mNumActors == 0 ) {
+			PxShape* shape = mShapeCache[ iter->second.mKey ];
+			updateMaterialRefs( shape, false );
+			shape->release();
+			mShapeCache.erase( iter->second.mKey );
+			iter = mShapeRefs.erase( iter );
+		} else {
+			++iter;
+		}
+	}
+}
+
+void Physx::clearScenes()
+{
+	vector<uint32_t> ids;
+	for ( const auto& iter : mScenes ) {
+		ids.push_back( iter.first );
+	}
+	for ( uint32_t id : ids ) {
+		eraseScene( id );
+	}
+}
+
+uint32_t Physx::createScene()
+{
+	return createScene( createSceneDesc() );
+}
+
+uint32_t Physx::createScene( const PxSceneDesc& desc )
+{
+	// Keeps the original 200-unit world, split so MBP has regions to 
+	// work with. Declare real bounds with the regions overload.
+	vector<PxBounds3> regions;
+	if ( desc.broadPhaseType == PxBroadPhaseType::eMBP ) {
+		regions = createBroadPhaseRegions( AxisAlignedBox( vec3( -100.0f ), vec3( 100.0f ) ), 4 );
+	}
+	return createScene( desc, regions );
+}
+
+uint32_t Physx::createScene( const PxSceneDesc& desc, const vector<PxBounds3>& regions )
+{
+	CI_ASSERT( mPhysics != nullptr );
+	PxScene* scene	= mPhysics->createScene( desc );
+	CI_ASSERT( scene != nullptr );
+	if ( scene->getBroadPhaseType() == PxBroadPhaseType::eMBP ) {
+		for ( const PxBounds3& bounds : regions ) {
+			PxBroadPhaseRegion broadPhaseRegion;
+			broadPhaseRegion.bounds		= bounds;
+			broadPhaseRegion.userData	= nullptr;
+			scene->addBroadPhaseRegion( broadPhaseRegion );
+		}
+	}
+	uint32_t id			= mScenes.empty() ? 0 : mScenes.rbegin()->first + 1;
+	uintptr_t userData	= id;
+	scene->userData		= (void*)userData;
+	mScenes[ id ]		= scene;
+	mSceneInfo[ id ]	= SceneInfo();
+
+	// Collect events unless the caller brought their own callback
+	if ( desc.simulationEventCallback == nullptr ) {
+		SceneInfo& info		= mSceneInfo[ id ];
+		info.mEventCallback	= make_shared<EventCallback>( id, mEventBufferSize );
+		scene->setSimulationEventCallback( info.mEventCallback.get() );
+	}
+	sortScenes();
+	if ( mRecorder ) {
+		mRecorder->writeScene( id, *scene );
+	}
+	return id;
+}
+
+PxSceneDesc Physx::createSceneDesc( PxBroadPhaseType::Enum broadPhaseType ) const
+{
+	CI_ASSERT( mPhysics != nullptr );
+	CI_ASSERT( mCpuDispatcher != nullptr );
+	PxSceneDesc desc( mPhysics->getTolerancesScale() );
+	desc.broadPhaseType			= broadPhaseType;
+	desc.cpuDispatcher			= mCpuDispatcher;
+	desc.filterShader			= FilterShader;
+	desc.filterShaderData		= &mFilterShaderData;
+	desc.filterShaderDataSize	= sizeof( FilterShaderData );
+
+	desc.flags					|= PxSceneFlag::eENABLE_ACTIVETRANSFORMS;
+	desc.gravity				= PxVec3( 0.0f, -9.81f, 0.0f );
+	
+#if PX_SUPPORT_GPU_PHYSX
+	if ( mCudaContextManager != nullptr && mCudaContextManager->contextIsValid() ) {
+		desc.gpuDispatcher = mCudaContextManager->getGpuDispatcher();
+	}
+#endif
+	return desc;
+}
+
+void Physx::eraseScene( uint32_t id )
+{
+	map<uint32_t, PxScene*>::iterator iter = mScenes.find( id );
+	if ( iter != mScenes.end() ) {
+		if ( iter->second != nullptr ) {
+			fetchScene( iter->second );
+			mSceneInfo[ id ].mBatchQueries.clear();
+			iter->second->release();
+			iter->second = nullptr;
+		}
+		mScenes.erase( iter );
+		mSceneInfo.erase( id );
+		sortScenes();
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_ERASE_SCENE );
+			mRecorder->write( id );
+		}
+	}
+}
+
+void Physx::eraseScene( PxScene* scene )
+{
+	for ( map<uint32_t, PxScene*>::iterator iter = mScenes.begin(); iter != mScenes.end(); ) {
+		if ( iter->second == scene ) {
+			if ( scene != nullptr ) {
+				fetchScene( scene );
+				mSceneInfo[ iter->first ].mBatchQueries.clear();
+				scene->release();
+				scene = nullptr;
+			}
+			if ( mRecorder ) {
+				mRecorder->writeOpcode( RECORD_ERASE_SCENE );
+				mRecorder->write( iter->first );
+			}
+			mSceneInfo.erase( iter->first );
+			iter = mScenes.erase( iter );
+			sortScenes();
+			break;
+		} else {
+			++iter;
+		}
+	}
+}
+
+PxScene* Physx::getScene( uint32_t id ) const
+{
+	if ( mScenes.find( id ) != mScenes.end() ) {
+		return mScenes.at( id );
+	}
+	return nullptr;
+}
+
+const map<uint32_t, PxScene*>& Physx::getScenes() const
+{
+	return mScenes;
+}
+
+int32_t Physx::getScenePriority( uint32_t id ) const
+{
+	map<uint32_t, SceneInfo>::const_iterator iter = mSceneInfo.find( id );
+	return iter != mSceneInfo.end() ? iter->second.mPriority : 0;
+}
+
+bool Physx::isSceneEnabled( uint32_t id ) const
+{
+	map<uint32_t, SceneInfo>::const_iterator iter = mSceneInfo.find( id );
+	return iter != mSceneInfo.end() && iter->second.mEnabled;
+}
+
+void Physx::setSceneEnabled( uint32_t id, bool enabled )
+{
+	map<uint32_t, SceneInfo>::iterator iter = mSceneInfo.find( id );
+	if ( iter != mSceneInfo.end() ) {
+		iter->second.mEnabled = enabled;
+		sortScenes();
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SCENE_ENABLED );
+			mRecorder->write( id );
+			mRecorder->write( (uint8_t)( enabled ? 1 : 0 ) );
+		}
+	}
+}
+
+void Physx::setScenePriority( uint32_t id, int32_t priority )
+{
+	map<uint32_t, SceneInfo>::iterator iter = mSceneInfo.find( id );
+	if ( iter != mSceneInfo.end() ) {
+		iter->second.mPriority = priority;
+		sortScenes();
+		if ( mRecorder ) {
+			mRecorder->writeOpcode( RECORD_SCENE_PRIORITY );
+			mRecorder->write( id );
+			mRecorder->write( priority );
+		}
+	}
+}
+
+void Physx::overlap( const OverlapQuery* queries, size_t count, QueryResults& results, uint32_t sceneId, 
+					 const PxQueryFilterData& filterData )
+{
+	// Any hit is enough to report an overlap
+	PxQueryFilterData anyHit	= filterData;
+	anyHit.flags				|= PxQueryFlag::eANY_HIT;
+	runBatchQueries( sceneId, count, results, [ & ]( BatchQuery& batch, size_t first, size_t n )
+	{
+		for ( size_t i = 0; i < n; ++i ) {
+			const OverlapQuery& query = queries[ first + i ];
+			batch.mQuery->overlap( query.mGeometry.any(), query.mPose, 0, anyHit );
+		}
+		batch.mQuery->execute();
+		for ( size_t i = 0; i < n; ++i ) {
+			const PxOverlapQueryResult& result	= batch.mOverlapResults[ i ];
+			size_t j							= first + i;
+			results.mHits[ j ]					= result.hasBlock ? 1 : 0;
+			results.mActorIds[ j ]				= result.hasBlock && result.block.actor != nullptr ? 
+				(uint32_t)(uintptr_t)result.block.actor->userData : kInvalidId;
+			results.mDistances[ j ]				= 0.0f;
+			results.mNormals[ j ]				= PxVec3( 0.0f );
+			results.mPositions[ j ]				= PxVec3( 0.0f );
+		}
+	} );
+}
+
+void Physx::raycast( const RaycastQuery* queries, size_t count, QueryResults& results, uint32_t sceneId, 
+					 const PxQueryFilterData& filterData )
+{
+	runBatchQueries( sceneId, count, results, [ & ]( BatchQuery& batch, size_t first, size_t n )
+	{
+		for ( size_t i = 0; i < n; ++i ) {
+			const RaycastQuery& query = queries[ first + i ];
+			batch.mQuery->raycast( query.mOrigin, query.mDirection, query.mDistance, 0, PxHitFlag::eDEFAULT, filterData );
+		}
+		batch.mQuery->execute();
+		for ( size_t i = 0; i < n; ++i ) {
+			const PxRaycastQueryResult& result	= batch.mRaycastResults[ i ];
+			size_t j							= first + i;
+			results.mHits[ j ]					= result.hasBlock ? 1 : 0;
+			results.mActorIds[ j ]				= result.hasBlock && result.block.actor != nullptr ? 
+				(uint32_t)(uintptr_t)result.block.actor->userData : kInvalidId;
+			results.mDistances[ j ]				= result.hasBlock ? result.block.distance : 0.0f;
+			results.mNormals[ j ]				= result.hasBlock ? result.block.normal : PxVec3( 0.0f );
+			results.mPositions[ j ]				= result.hasBlock ? result.block.position : PxVec3( 0.0f );
+		}
+	} );
+}
+
+void Physx::sweep( const SweepQuery* queries, size_t count, QueryResults& results, uint32_t sceneId, 
+				   const PxQueryFilterData& filterData )
+{
+	runBatchQueries( sceneId, count, results, [ & ]( BatchQuery& batch, size_t first, size_t n )
+	{
+		for ( size_t i = 0; i < n; ++i ) {
+			const SweepQuery& query = queries[ first + i ];
+			batch.mQuery->sweep( query.mGeometry.any(), query.mPose, query.mDirection, query.mDistance, 0, 
+				PxHitFlag::eDEFAULT, filterData );
+		}
+		batch.mQuery->execute();
+		for ( size_t i = 0; i < n; ++i ) {
+			const PxSweepQueryResult& result	= batch.mSweepResults[ i ];
+			size_t j							= first + i;
+			results.mHits[ j ]					= result.hasBlock ? 1 : 0;
+			results.mActorIds[ j ]				= result.hasBlock && result.block.actor != nullptr ? 
+				(uint32_t)(uintptr_t)result.block.actor->userData : kInvalidId;
+			results.mDistances[ j ]				= result.hasBlock ? result.block.distance : 0.0f;
+			results.mNormals[ j ]				= result.hasBlock ? result.block.normal : PxVec3( 0.0f );
+			results.mPositions[ j ]				= result.hasBlock ? result.block.position : PxVec3( 0.0f );
+		}
+	} );
+}
+
+void Physx::runBatchQueries( uint32_t sceneId, size_t count, QueryResults& results, 
+							 const function<void( BatchQuery&, size_t, size_t )>& run )
+{
+	results.mActorIds.resize( count );
+	results.mDistances.resize( count );
+	results.mHits.resize( count );
+	results.mNormals.resize( count );
+	results.mPositions.resize( count );
+
+	PxScene* scene = getScene( sceneId );
+	if ( scene == nullptr || count == 0 ) {
+		fill( results.mHits.begin(), results.mHits.end(), 0 );
+		fill( results.mActorIds.begin(), results.mActorIds.end(), kInvalidId );
+		return;
+	}
+
+	// Queries read the scene, which can't happen mid-step
+	fetchScene( scene );
+
+	// One batch per worker plus the calling thread, capped by the 
+	// number of chunks. Batches are created here, never on a worker.
+	size_t numChunks	= ( count + kQueryChunkSize - 1 ) / kQueryChunkSize;
+	size_t numBatches	= 1;
+	if ( mOwnedCpuDispatcher ) {
+		numBatches = min<size_t>( numChunks, mOwnedCpuDispatcher->getWorkerCount() + 1 );
+	}
+	SceneInfo& info = mSceneInfo[ sceneId ];
+	while ( info.mBatchQueries.size() < numBatches ) {
+		info.mBatchQueries.push_back( make_shared<BatchQuery>( scene ) );
+	}
+
+	// Batch b takes chunks b, b + numBatches, ...
+	auto runBatch = [ & ]( size_t b )
+	{
+		for ( size_t chunk = b; chunk < numChunks; chunk += numBatches ) {
+			size_t first = chunk * kQueryChunkSize;
+			run( *info.mBatchQueries[ b ], first, min( kQueryChunkSize, count - first ) );
+		}
+	};
+
+	mutex m;
+	condition_variable done;
+	size_t numRemaining = numBatches - 1;
+	for ( size_t b = 1; b < numBatches; ++b ) {
+		mOwnedCpuDispatcher->submit( [ &, b ]()
+		{
+			runBatch( b );
+			lock_guard<mutex> lock( m );
+			if ( --numRemaining == 0 ) {
+				done.notify_one();
+			}
+		} );
+	}
+	runBatch( 0 );
+
+	unique_lock<mutex> lock( m );
+	done.wait( lock, [ & ]() -> bool
+	{
+		return numRemaining == 0;
+	} );
+}
+
+PxFilterData Physx::createFilterData( uint32_t groups, uint32_t mask, uint32_t notifyMask )
+{
+	return PxFilterData( groups, mask, notifyMask, 0 );
+}
+
+const FilterShaderData& Physx::getFilterShaderData() const
+{
+	return mFilterShaderData;
+}
+
+void Physx::setFilterData( PxRigidActor& actor, const PxFilterData& filterData )
+{
+	// Shared shapes are swapped out, which can't happen mid-step
+	PxScene* scene = actor.getScene();
+	if ( scene != nullptr ) {
+		fetchScene( scene );
+	}
+
+	vector<PxShape*> shapes( actor.getNbShapes() );
+	if ( !shapes.empty() ) {
+		actor.getShapes( &shapes[ 0 ], (PxU32)shapes.size() );
+	}
+	for ( PxShape* shape : shapes ) {
+		setShapeFilterData( actor, shape, filterData );
+	}
+
+	// Killed pairs are only re-evaluated after a reset
+	if ( scene != nullptr ) {
+		scene->resetFiltering( actor );
+	}
+
+	uintptr_t id = (uintptr_t)actor.userData;
+	if ( mRecorder && findActor( (uint32_t)id ) != kActorInvalid ) {
+		mRecorder->writeOpcode( RECORD_FILTER_DATA );
+		mRecorder->write( (uint32_t)id );
+		mRecorder->write( filterData );
+	}
+}
+
+// Applies to scenes created afterward. PhysX copies the block when 
+// the scene is created.
+void Physx::setFilterShaderData( const FilterShaderData& data )
+{
+	mFilterShaderData = data;
+	if ( mRecorder ) {
+		mRecorder->writeOpcode( RECORD_FILTER_SHADER_DATA );
+		mRecorder->write( mFilterShaderData );
+	}
+}
+
+vector<PxBounds3> Physx::createBroadPhaseRegions( const AxisAlignedBox& worldBounds, uint32_t numSubdivisions, 
+												  uint32_t upAxis )
+{
+	// MBP supports at most 256 regions, or a 16 x 16 grid
+	numSubdivisions = min<uint32_t>( max<uint32_t>( numSubdivisions, 1 ), 16 );
+	vector<PxBounds3> regions( numSubdivisions * numSubdivisions );
+	PxU32 count = PxBroadPhaseExt::createRegionsFromWorldBounds( &regions[ 0 ], to( worldBounds ), 
+																 numSubdivisions, upAxis );
+	regions.resize( count );
+	return regions;
+}
+
+vector<PxBounds3> Physx::createBroadPhaseRegionsFromCellSize( const AxisAlignedBox& worldBounds, float cellSize, 
+															  uint32_t upAxis )
+{
+	CI_ASSERT( cellSize > 0.0f );
+	vec3 size		= worldBounds.getSize();
+	float extent	= 0.0f;
+	for ( uint32_t i = 0; i < 3; ++i ) {
+		if ( i != upAxis ) {
+			extent = max( extent, size[ i ] );
+		}
+	}
+	return createBroadPhaseRegions( worldBounds, (uint32_t)ceil( extent / cellSize ), upAxis );
+}
+
+uint32_t Physx::addBroadPhaseRegion( const AxisAlignedBox& bounds, uint32_t sceneId, bool populateRegion )
+{
+	PxScene* scene = getScene( sceneId );
+	if ( scene == nullptr || scene->getBroadPhaseType() != PxBroadPhaseType::eMBP ) {
+		return 0xffffffff;
+	}
+
+	// Regions can't change while a step is in flight
+	fetchScene( scene );
+	PxBroadPhaseRegion broadPhaseRegion;
+	broadPhaseRegion.bounds		= to( bounds );
+	broadPhaseRegion.userData	= nullptr;
+	return scene->addBroadPhaseRegion( broadPhaseRegion, populateRegion );
+}
+
+bool Physx::removeBroadPhaseRegion( uint32_t handle, uint32_t sceneId )
+{
+	PxScene* scene = getScene( sceneId );
+	if ( scene == nullptr || scene->getBroadPhaseType() != PxBroadPhaseType::eMBP ) {
+		return false;
+	}
+	fetchScene( scene );
+	return scene->removeBroadPhaseRegion( handle );
+}
+
+PxConvexMesh* Physx::createConvexMesh( const vector<vec3>& positions, PxConvexFlags flags )
+{
+	if ( positions.empty() ) {
+		return nullptr;
+	}
+	PxConvexMeshDesc desc;
+	desc.points.count	= (PxU32)positions.size();
+	desc.points.data	= (PxVec3*)&positions[ 0 ];
+	desc.points.stride	= sizeof( PxVec3 );
+	desc.flags			= flags;
+	return createConvexMesh( desc );
+}
+
+PxConvexMesh* Physx::createConvexMesh( const PxConvexMeshDesc& desc )
+{
+	fs::path cachePath = getCookingCachePath( updateCookingCachePath(), hashMeshDesc( desc ), "convex" );
+	if ( !cachePath.empty() ) {
+		MappedFile file( cachePath );
+		if ( file.isValid() ) {
+			PxDefaultMemoryInputData input( file.getData(), file.getSize() );
+			PxConvexMesh* mesh = mPhysics->createConvexMesh( input );
+			if ( mesh != nullptr ) {
+				return mesh;
+			}
+		}
+	}
+
+	PxDefaultMemoryOutputStream buffer;
+	if ( !mCooking->cookConvexMesh( desc, buffer ) ) {
+		return nullptr;
+	}
+	writeCookingCache( cachePath, buffer.getData(), buffer.getSize() );
+	
+	PxDefaultMemoryInputData input( buffer.getData(), buffer.getSize() );
+	return mPhysics->createConvexMesh( input );
+}
+
+PxTriangleMesh* Physx::createTriangleMesh( const vector<vec3>& positions, size_t numTriangles, const vector<uint32_t>& indices )
+{
+	if ( positions.empty() ) {
+		return nullptr;
+	}
+	if ( indices.empty() ) {
+		return createTriangleMesh( &positions[ 0 ], positions.size() );
+	}
+	if ( numTriangles == 0 ) {
+		numTriangles = indices.size() / 3;
+	}
+	CI_ASSERT( numTriangles * 3 <= indices.size() );
+	return createTriangleMesh( &positions[ 0 ], positions.size(), sizeof( vec3 ), &indices[ 0 ], numTriangles );
+}
+
+PxTriangleMesh* Physx::createTriangleMesh( const vec3* positions, size_t numPositions, size_t stride, 
+										  const uint32_t* indices, size_t numTriangles )
+{
+	if ( positions == nullptr || numPositions == 0 ) {
+		return nullptr;
+	}
+	if ( indices == nullptr ) {
+		CI_ASSERT( numPositions % 3 == 0 );
+		indices			= getSequentialIndices( numPositions );
+		numTriangles	= numPositions / 3;
+	}
+
+	PxTriangleMeshDesc desc;
+	desc.points.count		= (PxU32)numPositions;
+	desc.points.data		= positions;
+	desc.points.stride		= (PxU32)stride;
+	desc.triangles.count	= (PxU32)numTriangles;
+	desc.triangles.data		= indices;
+	desc.triangles.stride	= sizeof( uint32_t ) * 3;
+	return createTriangleMesh( desc );
+}
+
+PxTriangleMesh* Physx::createTriangleMesh( const vec3* positions, size_t numPositions, size_t stride, 
+										  const uint16_t* indices, size_t numTriangles )
+{
+	if ( positions == nullptr || numPositions == 0 || indices == nullptr ) {
+		return nullptr;
+	}
+
+	PxTriangleMeshDesc desc;
+	desc.points.count		= (PxU32)numPositions;
+	desc.points.data		= positions;
+	desc.points.stride		= (PxU32)stride;
+	desc.triangles.count	= (PxU32)numTriangles;
+	desc.triangles.data		= indices;
+	desc.triangles.stride	= sizeof( uint16_t ) * 3;
+	desc.flags				= PxMeshFlag::e16_BIT_INDICES;
+	return createTriangleMesh( desc );
+}
+
+PxTriangleMesh* Physx::createTriangleMesh( const TriMesh& mesh )
+{
+	if ( mesh.getPositionsDims() != 3 ) {
+		CI_LOG_E( "Triangle meshes need 3D positions, got " << (uint32_t)mesh.getPositionsDims() );
+		return nullptr;
+	}
+	const vector<uint32_t>& indices = mesh.getIndices();
+	return createTriangleMesh( mesh.getPositions<3>(), mesh.getNumVertices(), sizeof( vec3 ), 
+		indices.empty() ? nullptr : &indices[ 0 ], mesh.getNumTriangles() );
+}
+
+PxTriangleMesh* Physx::createTriangleMesh( const PxTriangleMeshDesc& desc )
+{
+	fs::path cachePath = getCookingCachePath( updateCookingCachePath(), hashMeshDesc( desc ), "trimesh" );
+	if ( !cachePath.empty() ) {
+		MappedFile file( cachePath );
+		if ( file.isValid() ) {
+			PxDefaultMemoryInputData readBuffer( file.getData(), file.getSize() );
+			PxTriangleMesh* mesh = mPhysics->createTriangleMesh( readBuffer );
+			if ( mesh != nullptr ) {
+				return mesh;
+			}
+		}
+	}
+
+	PxDefaultMemoryOutputStream writeBuffer;
+	if ( !mCooking->cookTriangleMesh( desc, writeBuffer ) ) {
+		return nullptr;
+	}
+	writeCookingCache( cachePath, writeBuffer.getData(), writeBuffer.getSize() );
+	
+	PxDefaultMemoryInputData readBuffer( writeBuffer.getData(), writeBuffer.getSize() );
+	return mPhysics->createTriangleMesh( readBuffer );
+}
+
+Physx::ConvexMeshFuture Physx::createConvexMeshAsync( const vector<vec3>& positions, PxConvexFlags flags )
+{
+	typedef packaged_task<vector<PxU8>()> Task;
+	// The cache directory is copied now since it may change while this 
+	// runs on the pool
+	fs::path cacheDirectory = updateCookingCachePath();
+	shared_ptr<Task> task( new Task( [ this, positions, flags, cacheDirectory ]() -> vector<PxU8>
+	{
+		PxConvexMeshDesc desc;
+		desc.points.count	= (PxU32)positions.size();
+		desc.points.data	= positions.empty() ? nullptr : (PxVec3*)&positions[ 0 ];
+		desc.points.stride	= sizeof( PxVec3 );
+		desc.flags			= flags;
+		return positions.empty() ? vector<PxU8>() : cookConvexMesh( desc, cacheDirectory );
+	} ) );
+	shared_ptr<ConvexMeshFuture::State> state( new ConvexMeshFuture::State( mPhysics, mAlive, task->get_future().share() ) );
+	getCookingPool().submit( [ task ]()
+	{
+		( *task )();
+	} );
+	return ConvexMeshFuture( state );
+}
+
+vector<Physx::ConvexMeshFuture> Physx::createConvexMeshesAsync( const vector<vector<vec3>>& positions, PxConvexFlags flags )
+{
+	vector<ConvexMeshFuture> futures;
+	futures.reserve( positions.size() );
+	for ( const vector<vec3>& p : positions ) {
+		futures.push_back( createConvexMeshAsync( p, flags ) );
+	}
+	return futures;
+}
+
+Physx::TriangleMeshFuture Physx::createTriangleMeshAsync( const vector<vec3>& positions, const vector<uint32_t>& indices )
+{
+	typedef packaged_task<vector<PxU8>()> Task;
+	fs::path cacheDirectory = updateCookingCachePath();
+	shared_ptr<Task> task( new Task( [ this, positions, indices, cacheDirectory ]() -> vector<PxU8>
+	{
+		if ( positions.empty() ) {
+			return vector<PxU8>();
+		}
+		vector<uint32_t> sequence;
+		const vector<uint32_t>* triangles = &indices;
+		if ( indices.empty() ) {
+			CI_ASSERT( positions.size() % 3 == 0 );
+			sequence.resize( positions.size() );
+			for ( size_t i = 0; i < sequence.size(); ++i ) {
+				sequence[ i ] = (uint32_t)i;
+			}
+			triangles = &sequence;
+		}
+
+		PxTriangleMeshDesc desc;
+		desc.points.count		= (PxU32)positions.size();
+		desc.points.data		= (PxVec3*)&positions[ 0 ];
+		desc.points.stride		= sizeof( PxVec3 );
+		desc.triangles.count	= (PxU32)( triangles->size() / 3 );
+		desc.triangles.data		= (PxU32*)&( *triangles )[ 0 ];
+		desc.triangles.stride	= sizeof( PxU32 ) * 3;
+		return cookTriangleMesh( desc, cacheDirectory );
+	} ) );
+	shared_ptr<TriangleMeshFuture::State> state( new TriangleMeshFuture::State( mPhysics, mAlive, task->get_future().share() ) );
+	getCookingPool().submit( [ task ]()
+	{
+		( *task )();
+	} );
+	return TriangleMeshFuture( state );
+}
+
+vector<Physx::TriangleMeshFuture> Physx::createTriangleMeshesAsync( const vector<vector<vec3>>& positions, 
+																	const vector<vector<uint32_t>>& indices )
+{
+	vector<TriangleMeshFuture> futures;
+	futures.reserve( positions.size() );
+	for ( size_t i = 0; i < positions.size(); ++i ) {
+		futures.push_back( createTriangleMeshAsync( positions[ i ], i < indices.size() ? indices[ i ] : vector<uint32_t>() ) );
+	}
+	return futures;
+}
+
+vector<PxU8> Physx::cookConvexMesh( const PxConvexMeshDesc& desc, const fs::path& cacheDirectory ) const
+{
+	vector<PxU8> data;
+	fs::path cachePath = getCookingCachePath( cacheDirectory, hashMeshDesc( desc ), "convex" );
+	if ( !cachePath.empty() ) {
+		MappedFile file( cachePath );
+		if ( file.isValid() ) {
+			data.assign( file.getData(), file.getData() + file.getSize() );
+			return data;
+		}
+	}
+
+	VectorOutputStream stream( data );
+	if ( !mCooking->cookConvexMesh( desc, stream ) ) {
+		return vector<PxU8>();
+	}
+	if ( !data.empty() ) {
+		writeCookingCache( cachePath, &data[ 0 ], (PxU32)data.size() );
+	}
+	return data;
+}
+
+vector<PxU8> Physx::cookTriangleMesh( const PxTriangleMeshDesc& desc, const fs::path& cacheDirectory ) const
+{
+	vector<PxU8> data;
+	fs::path cachePath = getCookingCachePath( cacheDirectory, hashMeshDesc( desc ), "trimesh" );
+	if ( !cachePath.empty() ) {
+		MappedFile file( cachePath );
+		if ( file.isValid() ) {
+			data.assign( file.getData(), file.getData() + file.getSize() );
+			return data;
+		}
+	}
+
+	VectorOutputStream stream( data );
+	if ( !mCooking->cookTriangleMesh( desc, stream ) ) {
+		return vector<PxU8>();
+	}
+	if ( !data.empty() ) {
+		writeCookingCache( cachePath, &data[ 0 ], (PxU32)data.size() );
+	}
+	return data;
+}
+
+// Shared 0..N index list for non-indexed input. Grows on demand and 
+// is never shrunk, so repeated calls don't allocate.
+const uint32_t* Physx::getSequentialIndices( size_t count )
+{
+	size_t size = mSequentialIndices.size();
+	if ( size < count ) {
+		mSequentialIndices.resize( count );
+		for ( size_t i = size; i < count; ++i ) {
+			mSequentialIndices[ i ] = (uint32_t)i;
+		}
+	}
+	return &mSequentialIndices[ 0 ];
+}
+
+Physx::ThreadPool& Physx::getCookingPool()
+{
+	if ( !mCookingPool ) {
+		mCookingPool.reset( new ThreadPool( max<size_t>( System::getNumCores(), 1 ) ) );
+	}
+	return *mCookingPool;
+}
+
+const fs::path& Physx::getCookingCacheDirectory() const
+{
+	return mCookingCacheDirectory;
+}
+
+void Physx::setCookingCacheDirectory( const fs::path& path )
+{
+	mCookingCacheDirectory	= path;
+	mCookingCacheParams		= 0;
+	mCookingCachePath		= fs::path();
+	updateCookingCachePath();
+}
+
+// Entries live in a folder named for the cooking parameters. Those can 
+// change through getCooking(), so the folder is checked before each use. 
+// Folders for other parameters are left alone since another instance 
+// may be using them.
+const fs::path& Physx::updateCookingCachePath()
+{
+	if ( mCookingCacheDirectory.empty() ) {
+		return mCookingCachePath;
+	}
+	uint64_t params = hashCookingParams( mCooking->getParams() );
+	if ( params == mCookingCacheParams ) {
+		return mCookingCachePath;
+	}
+
+	mCookingCacheParams	= params;
+	mCookingCachePath	= fs::path();
+	fs::path path		= mCookingCacheDirectory / toHex( params );
+	try {
+		fs::create_directories( path );
+		mCookingCachePath = path;
+	} catch ( const std::exception& ex ) {
+		CI_LOG_W( "Unable to use cooking cache at " << mCookingCacheDirectory << ": " << ex.what() );
+	}
+	return mCookingCachePath;
+}
+
+fs::path Physx::getCookingCachePath( const fs::path& directory, uint64_t key, const string& extension )
+{
+	if ( directory.empty() ) {
+		return fs::path();
+	}
+	return directory / ( toHex( key ) + "." + extension );
+}
+
+void Physx::writeCookingCache( const fs::path& path, const PxU8* data, PxU32 size ) const
+{
+	if ( path.empty() ) {
+		return;
+	}
+
+	// Write to a temporary file first so a partially written entry is 
+	// never picked up by another run. Each thread gets its own name, as 
+	// the same mesh may be cooked on two threads at once.
+	fs::path tempPath = path;
+	tempPath += "." + toHex( hash<thread::id>()( this_thread::get_id() ) ) + ".tmp";
+	bool written = false;
+	{
+		ofstream file( tempPath.string().c_str(), ios::binary | ios::trunc );
+		if ( file.is_open() ) {
+			file.write( (const char*)data, size );
+			written = file.good();
+		}
+	}
+	try {
+		if ( written ) {
+			fs::rename( tempPath, path );
+			return;
+		}
+	} catch ( const std::exception& ex ) {
+		CI_LOG_W( "Unable to write cooking cache entry " << path << ": " << ex.what() );
+	}
+	try {
+		fs::remove( tempPath );
+	} catch ( const std::exception& ) {
+	}
+}
+
+uint32_t Physx::loadSnapshot( const fs::path& path, uint32_t sceneId )
+{
+	if ( sceneId != kInvalidId && getScene( sceneId ) == nullptr ) {
+		CI_LOG_E( "Unable to load snapshot " << path << " into missing scene " << sceneId );
+		return kInvalidId;
+	}
+
+	unique_ptr<Snapshot> snapshot( new Snapshot( path ) );
+	MappedFile& file = snapshot->mFile;
+	if ( !file.isValid() || ( (uintptr_t)file.getData() & ( PX_SERIAL_FILE_ALIGN - 1 ) ) != 0 ) {
+		CI_LOG_E( "Unable to map snapshot " << path );
+		return kInvalidId;
+	}
+
+	PxSerializationRegistry* registry	= PxSerialization::createSerializationRegistry( *mPhysics );
+	PxCollection* collection			= PxSerialization::createCollectionFromBinary( file.getData(), *registry );
+	registry->release();
+	if ( collection == nullptr ) {
+		CI_LOG_E( "Unable to deserialize snapshot " << path );
+		return kInvalidId;
+	}
+
+	if ( sceneId == kInvalidId ) {
+		sceneId = createScene();
+	}
+	PxScene* scene = getScene( sceneId );
+	CI_ASSERT( scene != nullptr );
+
+	// Actors were saved with their ID plus one because zero 
+	// is reserved for objects without one
+	vector<PxActor*> actors;
+	for ( PxU32 i = 0; i < collection->getNbObjects(); ++i ) {
+		PxBase& object = collection->getObject( i );
+		if ( object.getConcreteType() == PxConcreteType::eRIGID_DYNAMIC || 
+			 object.getConcreteType() == PxConcreteType::eRIGID_STATIC ) {
+			PxActor* actor			= static_cast<PxRigidActor*>( &object );
+			PxSerialObjectId id		= collection->getId( object );
+			uint32_t preferredId	= id == PX_SERIAL_OBJECT_ID_INVALID ? kInvalidId : (uint32_t)( id - 1 );
+			uint32_t actorId		= acquireActorId( actor, preferredId );
+			if ( actorId == kInvalidId ) {
+				actor->release();
+				continue;
+			}
+			actors.push_back( actor );
+			if ( mRecorder ) {
+				mRecorder->writeActor( sceneId, actorId, *actor );
+			}
+		}
+	}
+	collection->release();
+
+	if ( isSimulating( scene ) ) {
+		for ( PxActor* actor : actors ) {
+			scene->addActor( *actor );
+		}
+	} else if ( !actors.empty() ) {
+		scene->addActors( &actors[ 0 ], (PxU32)actors.size() );
+	}
+
+	mSnapshots.push_back( move( snapshot ) );
+	return sceneId;
+}
+
+bool Physx::saveSnapshot( uint32_t sceneId, const fs::path& path )
+{
+	PxScene* scene = getScene( sceneId );
+	if ( scene == nullptr ) {
+		return false;
+	}
+	fetchScene( scene );
+
+	// Only actors are added explicitly. Completing the collection 
+	// pulls in their shapes, materials and meshes.
+	PxCollection* collection = PxCreateCollection();
+	for ( size_t i = mNumClearedActors; i < mActors.size(); ++i ) {
+		const pair<uint32_t, PxActor*>& iter = mActors[ i ];
+		if ( !mActorSlots[ iter.first & kActorIndexMask ].mErased && iter.second->getScene() == scene ) {
+			collection->add( *iter.second, (PxSerialObjectId)iter.first + 1 );
+		}
+	}
+
+	PxSerializationRegistry* registry = PxSerialization::createSerializationRegistry( *mPhysics );
+	PxSerialization::complete( *collection, *registry );
+
+	vector<PxU8> data;
+	VectorOutputStream stream( data );
+	bool success = PxSerialization::serializeCollectionToBinary( stream, *collection, *registry );
+	collection->release();
+	registry->release();
+	if ( !success || data.empty() ) {
+		CI_LOG_E( "Unable to serialize scene " << sceneId );
+		return false;
+	}
+
+	ofstream file( path.string().c_str(), ios::binary | ios::trunc );
+	if ( !file.is_open() ) {
+		return false;
+	}
+	file.write( (const char*)&data[ 0 ], data.size() );
+	return file.good();
+}
+
+#if !defined( CINDER_COCOA_TOUCH )
+void Physx::pvdConnect( const string& host, int32_t port, 
+						 int32_t timeout, PxVisualDebuggerConnectionFlags connectionFlags )
+{
+	pvdDisconnect();
+	if ( mPhysics->getPvdConnectionManager() ) {
+		mPvdConnection = PxVisualDebuggerExt::createConnection( 
+			mPhysics->getPvdConnectionManager(), 
+			host.c_str(), port, timeout, connectionFlags );
+	}
+}
+
+void Physx::pvdDisconnect()
+{
+	if ( mPhysics->getPvdConnectionManager() ) {
+		if ( mPvdConnection != nullptr ) {
+			if ( mPvdConnection->isConnected() ) {
+				mPvdConnection->disconnect();
+			}
+			mPvdConnection->release();
+			mPvdConnection = nullptr;
+		}
+		if ( mPhysics->getPvdConnectionManager()->isConnected() ) {
+			mPhysics->getPvdConnectionManager()->disconnect();
+		}
+	}
+}
+
+void Physx::onPvdSendClassDescriptions( PvdConnection& )
 {
-	return PxTransform( to( v ), to( q ) );
 }
 
-PxBounds3 Physx::to( const AxisAlignedBox& b )
+void Physx::onPvdConnected( PvdConnection& )
 {
-	return PxBounds3( to( b.getMin() ), to( b.getMax() ) );
+	mPhysics->getVisualDebugger()->setVisualizeConstraints( true );
+	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_CONSTRAINTS,	true );
+	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_CONTACTS,		true );
+	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_SCENEQUERIES, true );
 }
 
-PxDefaultAllocator Physx::getAllocator() const
+void Physx::onPvdDisconnected( PvdConnection& )
 {
-	return mAllocator;
 }
+#endif
 
-PxCooking* Physx::getCooking() const
+Physx::SceneInfo::SceneInfo()
+: mEnabled( true ), mNumSteps( 0 ), mPriority( 0 ), mStatistics( PxSimulationStatistics() )
 {
-	return mCooking;
 }
 
-PxDefaultCpuDispatcher* Physx::getCpuDispatcher() const
+PxErrorCallback& Physx::getErrorCallback()
 {
-	return mCpuDispatcher;
+	static PxDefaultErrorCallback defaultErrorCallback;
+	return defaultErrorCallback;
 }
 
-#if PX_SUPPORT_GPU_PHYSX
-PxCudaContextManager* Physx::getCudaContextManager() const
+uint32_t Physx::acquireActorId( PxActor* actor, uint32_t preferredId )
 {
-	return mCudaContextManager;
-}
-#endif
+	uint32_t slot = 0;
+	if ( preferredId != kInvalidId && claimActorSlot( preferredId ) ) {
+		slot = preferredId & kActorIndexMask;
+	} else if ( mFreeActorSlots.empty() ) {
+		if ( mActorSlots.size() >= kActorIndexMask ) {
+			CI_LOG_E( "Out of actor IDs; at most " << kActorIndexMask << " actors can exist at once" );
+			return kInvalidId;
+		}
+		slot = addActorSlot();
+	} else {
+		slot = mFreeActorSlots.back();
+		removeFreeActorSlot( slot );
+	}
 
-PxFoundation* Physx::getFoundation() const
-{
-	return mFoundation;
-}
+	ActorSlot& actorSlot	= mActorSlots[ slot ];
+	actorSlot.mErased		= false;
+	actorSlot.mIndex		= (uint32_t)mActors.size();
+	uint32_t id				= ( actorSlot.mGeneration << kActorIndexBits ) | slot;
+	uintptr_t userData		= id;
+	actor->userData			= (void*)userData;
 
-PxPhysics* Physx::getPhysics() const
-{
-	return mPhysics;
+	PxTransform pose( PxIdentity );
+	if ( actor->getType() == PxActorType::eRIGID_DYNAMIC || 
+		 actor->getType() == PxActorType::eRIGID_STATIC ) {
+		pose = static_cast<PxRigidActor*>( actor )->getGlobalPose();
+	}
+	mActors.push_back( make_pair( id, actor ) );
+	mPreviousPoses.push_back( pose );
+	updateShapeRefs( actor, true );
+	++mNumActorChanges;
+	return id;
 }
 
-PxProfileZoneManager* Physx::getProfileZoneManager() const
+void Physx::applyCommands()
 {
-	return mProfileZoneManager;
-}
+	if ( !mCommandQueue ) {
+		return;
+	}
 
-#if !defined( CINDER_COCOA_TOUCH )
-PvdConnection* Physx::getPvdConnection() const
-{
-	return mPvdConnection;
-}
-#endif
+	// Runs of adds to the same scene go in as one batch
+	PxScene* scene = nullptr;
+	Command command;
+	while ( mCommandQueue->mCommands.pop( command ) ) {
+		PxScene* commandScene = command.mType == COMMAND_ADD_ACTOR ? getScene( command.mSceneId ) : nullptr;
+		if ( !mQueuedActors.empty() && commandScene != scene ) {
+			scene->addActors( &mQueuedActors[ 0 ], (PxU32)mQueuedActors.size() );
+			mQueuedActors.clear();
+		}
+		scene = commandScene;
 
-void Physx::update( float deltaInSeconds )
-{
-	for ( uint32_t id : mDeletedActors ) {
-		map<uint32_t, PxActor*>::iterator iter = mActors.find( id );
-		if ( iter != mActors.end() ) {
-			if ( iter->second != nullptr ) {
-				iter->second->release();
-				iter->second = nullptr;
+		switch ( command.mType ) {
+		case COMMAND_ADD_ACTOR:
+			{
+				// Hand the reserved slot back so the actor can claim it
+				uint32_t slot					= command.mId & kActorIndexMask;
+				mActorSlots[ slot ].mReserved	= false;
+				addFreeActorSlot( slot );
+				--mCommandQueue->mNumReservedIds;
+
+				uint32_t id = acquireActorId( command.mActor, command.mId );
+				CI_ASSERT( id == command.mId );
+				if ( scene == nullptr ) {
+					CI_LOG_E( "Scene " << command.mSceneId << " does not exist" );
+					eraseActor( id );
+					break;
+				}
+				mQueuedActors.push_back( command.mActor );
+				if ( mRecorder ) {
+					mRecorder->writeActor( command.mSceneId, id, *command.mActor );
+				}
 			}
-			mActors.erase( iter );
+			break;
+		case COMMAND_ERASE_ACTOR:
+			eraseActor( command.mId );
+			break;
+		case COMMAND_SET_ANGULAR_VELOCITY:
+			setAngularVelocity( command.mId, command.mVelocity );
+			break;
+		case COMMAND_SET_GLOBAL_POSE:
+			setGlobalPose( command.mId, command.mPose );
+			break;
+		case COMMAND_SET_KINEMATIC_TARGET:
+			setKinematicTarget( command.mId, command.mPose );
+			break;
+		case COMMAND_SET_LINEAR_VELOCITY:
+			setLinearVelocity( command.mId, command.mVelocity );
+			break;
 		}
 	}
-	mDeletedActors.clear();
-
-	for ( auto& iter : mScenes ) {
-		iter.second->simulate( deltaInSeconds );
-		while ( !iter.second->fetchResults( true ) ) {
-		}
+	if ( !mQueuedActors.empty() ) {
+		scene->addActors( &mQueuedActors[ 0 ], (PxU32)mQueuedActors.size() );
+		mQueuedActors.clear();
 	}
+	reserveActorIds();
 }
 
-uint32_t Physx::addActor( PxActor* actor, uint32_t sceneId )
+// Reserves the slot and generation encoded in id when the slot is free 
+// and reusing it can't revive a handle that was already released
+bool Physx::claimActorSlot( uint32_t id )
 {
-	return addActor( actor, getScene( sceneId ) );
+	uint32_t slot		= id & kActorIndexMask;
+	uint32_t generation	= id >> kActorIndexBits;
+	if ( slot >= kActorIndexMask ) {
+		return false;
+	}
+	if ( slot >= mActorSlots.size() ) {
+		while ( mActorSlots.size() < slot ) {
+			addFreeActorSlot( addActorSlot() );
+		}
+		addActorSlot();
+	} else {
+		if ( mActorSlots[ slot ].mFreeIndex == kActorSlotInUse || generation < mActorSlots[ slot ].mGeneration ) {
+			return false;
+		}
+		removeFreeActorSlot( slot );
+	}
+	mActorSlots[ slot ].mGeneration = generation;
+	return true;
 }
 
-uint32_t Physx::addActor( PxActor* actor, PxScene* scene )
+void Physx::beginStep( float deltaInSeconds )
 {
-	uint32_t id			= mActors.empty() ? 0 : mActors.rbegin()->first + 1;
-	uintptr_t userData	= id;
-	actor->userData		= (void*)userData;
-	mActors[ id ]		= actor;
-	scene->addActor( *actor );
-	return id;
-}
+	double t = getMilliseconds();
+	releaseDeletedActors();
+	double d = getMilliseconds();
+	mStepStatsPending.mTimes[ STEP_DELETION ] += d - t;
 
-void Physx::clearActors()
-{
-	for ( const auto& iter : mActors ) {
-		eraseActor( iter.first );
+	// Kick every enabled scene before collecting any of them so 
+	// independent scenes share the dispatcher's worker threads
+	for ( PxScene* scene : mScenesByPriority ) {
+		scene->simulate( deltaInSeconds );
+		mSimulatingScenes.push_back( scene );
 	}
+	mStepStatsPending.mTimes[ STEP_SIMULATE ] += getMilliseconds() - d;
+	++mStepStatsPending.mNumSteps;
+	mStepStatsReady = true;
 }
 
-void Physx::eraseActor( uint32_t id )
+void Physx::bufferActiveTransforms( PxScene* scene )
 {
-	mDeletedActors.push_back( id );
+	if ( !( scene->getFlags() & PxSceneFlag::eENABLE_ACTIVETRANSFORMS ) ) {
+		return;
+	}
+	uintptr_t id							= (uintptr_t)scene->userData;
+	SceneInfo& sceneInfo					= mSceneInfo.at( (uint32_t)id );
+	vector<PxActiveTransform>& transforms	= sceneInfo.mActiveTransforms;
+
+	// The transform's userData is the actor's, which holds our actor ID
+	PxU32 count									= 0;
+	const PxActiveTransform* activeTransforms	= scene->getActiveTransforms( count );
+	transforms.insert( transforms.end(), activeTransforms, activeTransforms + count );
+
+	// Actors that moved in more than one substep this frame only keep 
+	// their latest transform
+	if ( ++sceneInfo.mNumSteps > 1 ) {
+		stable_sort( transforms.begin(), transforms.end(), []( const PxActiveTransform& a, const PxActiveTransform& b ) -> bool
+		{
+			return a.actor < b.actor;
+		} );
+		vector<PxActiveTransform>::iterator last = transforms.begin();
+		for ( vector<PxActiveTransform>::iterator iter = transforms.begin(); iter != transforms.end(); ++iter ) {
+			if ( iter->actor != last->actor ) {
+				++last;
+			}
+			*last = *iter;
+		}
+		transforms.erase( transforms.empty() ? transforms.end() : last + 1, transforms.end() );
+	}
 }
 
-void Physx::eraseActor( PxActor& actor )
+void Physx::fetchScene( PxScene* scene )
 {
-	uintptr_t id = (uintptr_t)actor.userData;
-	eraseActor( (uint32_t)id );
+	vector<PxScene*>::iterator iter = find( mSimulatingScenes.begin(), mSimulatingScenes.end(), scene );
+	if ( iter != mSimulatingScenes.end() ) {
+		double t = getMilliseconds();
+		while ( !scene->fetchResults( true ) ) {
+		}
+		mStepStatsPending.mTimes[ STEP_FETCH ] += getMilliseconds() - t;
+		finishScene( scene );
+		mSimulatingScenes.erase( iter );
+	}
 }
 
-void Physx::eraseActor( PxActor* actor )
+void Physx::finishScene( PxScene* scene )
 {
-	uintptr_t id = (uintptr_t)actor->userData;
-	eraseActor( (uint32_t)id );
+	double t = getMilliseconds();
+	bufferActiveTransforms( scene );
+	mStepStatsPending.mTimes[ STEP_ACTIVE_TRANSFORMS ] += getMilliseconds() - t;
+
+	uintptr_t id = (uintptr_t)scene->userData;
+	scene->getSimulationStatistics( mSceneInfo.at( (uint32_t)id ).mStatistics );
 }
 
-PxActor* Physx::getActor( uint32_t id ) const
+// Publishes the last update's timings once all of its scenes are in
+void Physx::finishStats()
 {
-	if ( mActors.find( id ) != mActors.end() ) {
-		return mActors.at( id );
+	if ( !mStepStatsReady || !mSimulatingScenes.empty() ) {
+		return;
 	}
-	return nullptr;
+	mStepStats = mStepStatsPending;
+	for ( size_t i = 0; i < STEP_TIMER_COUNT; ++i ) {
+		mStepHistory[ i ].add( mStepStats.mTimes[ i ] );
+	}
+	mStepStatsPending	= StepStats();
+	mStepStatsReady		= false;
 }
 
-const map<uint32_t, PxActor*>& Physx::getActors() const
+void Physx::waitForScenes()
 {
-	return mActors;
+	// Collect scenes in the order they finish, blocking on the 
+	// highest priority scene only when none are ready. Time spent 
+	// copying active transforms is counted separately.
+	double t		= getMilliseconds();
+	double copyTime	= mStepStatsPending.mTimes[ STEP_ACTIVE_TRANSFORMS ];
+	while ( !mSimulatingScenes.empty() ) {
+		bool fetched = false;
+		for ( vector<PxScene*>::iterator iter = mSimulatingScenes.begin(); iter != mSimulatingScenes.end(); ) {
+			if ( ( *iter )->checkResults( false ) ) {
+				( *iter )->fetchResults( true );
+				finishScene( *iter );
+				iter	= mSimulatingScenes.erase( iter );
+				fetched	= true;
+			} else {
+				++iter;
+			}
+		}
+		if ( !fetched ) {
+			PxScene* scene = mSimulatingScenes.front();
+			while ( !scene->fetchResults( true ) ) {
+			}
+			finishScene( scene );
+			mSimulatingScenes.erase( mSimulatingScenes.begin() );
+		}
+	}
+	copyTime = mStepStatsPending.mTimes[ STEP_ACTIVE_TRANSFORMS ] - copyTime;
+	mStepStatsPending.mTimes[ STEP_FETCH ] += getMilliseconds() - t - copyTime;
 }
 
-void Physx::clearScenes()
+void Physx::sortScenes()
 {
 	vector<uint32_t> ids;
-	for ( const auto& iter : mScenes ) {
-		ids.push_back( iter.first );
+	for ( const auto& iter : mSceneInfo ) {
+		if ( iter.second.mEnabled ) {
+			ids.push_back( iter.first );
+		}
 	}
+	stable_sort( ids.begin(), ids.end(), [ & ]( uint32_t a, uint32_t b ) -> bool
+	{
+		return mSceneInfo.at( a ).mPriority > mSceneInfo.at( b ).mPriority;
+	} );
+
+	mScenesByPriority.clear();
 	for ( uint32_t id : ids ) {
-		eraseScene( id );
+		mScenesByPriority.push_back( mScenes.at( id ) );
 	}
 }
 
-uint32_t Physx::createScene()
+bool Physx::isSimulating( PxScene* scene ) const
 {
-	CI_ASSERT( mPhysics != nullptr );
-	CI_ASSERT( mCpuDispatcher != nullptr );
-	PxSceneDesc desc( mPhysics->getTolerancesScale() );
-	desc.broadPhaseType = PxBroadPhaseType::eMBP;
-	desc.cpuDispatcher	= mCpuDispatcher;
-	desc.filterShader	= FilterShader;
+	return find( mSimulatingScenes.begin(), mSimulatingScenes.end(), scene ) != mSimulatingScenes.end();
+}
 
-	desc.flags			|= PxSceneFlag::eENABLE_ACTIVETRANSFORMS;
-	desc.gravity		= PxVec3( 0.0f, -9.81f, 0.0f );
-	
-#if PX_SUPPORT_GPU_PHYSX
-	if ( mCudaContextManager != nullptr && mCudaContextManager->contextIsValid() ) {
-		desc.gpuDispatcher = mCudaContextManager->getGpuDispatcher();
-	}
-#endif
-	return createScene( desc );
+uint32_t Physx::addActorSlot()
+{
+	ActorSlot actorSlot;
+	actorSlot.mErased		= false;
+	actorSlot.mFreeIndex	= kActorSlotInUse;
+	actorSlot.mGeneration	= 0;
+	actorSlot.mIndex		= 0;
+	actorSlot.mReserved		= false;
+	mActorSlots.push_back( actorSlot );
+	return (uint32_t)mActorSlots.size() - 1;
 }
 
-uint32_t Physx::createScene( const PxSceneDesc& desc )
+void Physx::addFreeActorSlot( uint32_t slot )
 {
-	CI_ASSERT( mPhysics != nullptr );
-	PxScene* scene	= mPhysics->createScene( desc );
-	PxBroadPhaseRegion broadPhaseRegion;
-	broadPhaseRegion.bounds = to( AxisAlignedBox( vec3( -100.0f ), vec3( 100.0f ) ) );
-	scene->addBroadPhaseRegion( broadPhaseRegion );
-	CI_ASSERT( scene != nullptr );
-	uint32_t id		= mScenes.empty() ? 0 : mScenes.rbegin()->first + 1;
-	mScenes[ id ]	= scene;
-	return id;
+	mActorSlots[ slot ].mFreeIndex = (uint32_t)mFreeActorSlots.size();
+	mFreeActorSlots.push_back( slot );
 }
 
-void Physx::eraseScene( uint32_t id )
+void Physx::freeActorSlot( uint32_t id )
 {
-	map<uint32_t, PxScene*>::iterator iter = mScenes.find( id );
-	if ( iter != mScenes.end() ) {
-		if ( iter->second != nullptr ) {
-			iter->second->release();
-			iter->second = nullptr;
-		}
-		mScenes.erase( iter );
+	uint32_t slot			= id & kActorIndexMask;
+	ActorSlot& actorSlot	= mActorSlots[ slot ];
+	actorSlot.mErased		= false;
+	if ( actorSlot.mGeneration < kActorGenerationMax ) {
+		++actorSlot.mGeneration;
+		addFreeActorSlot( slot );
 	}
 }
 
-void Physx::eraseScene( PxScene* scene )
+size_t Physx::findActor( uint32_t id ) const
 {
-	for ( map<uint32_t, PxScene*>::iterator iter = mScenes.begin(); iter != mScenes.end(); ) {
-		if ( iter->second == scene ) {
-			if ( scene != nullptr ) {
-				scene->release();
-				scene = nullptr;
-			}
-			iter = mScenes.erase( iter );
-			break;
-		} else {
-			++iter;
+	uint32_t slot = id & kActorIndexMask;
+	if ( slot < mActorSlots.size() ) {
+		const ActorSlot& actorSlot = mActorSlots[ slot ];
+		if ( !actorSlot.mReserved && actorSlot.mGeneration == ( id >> kActorIndexBits ) && 
+			 actorSlot.mIndex < mActors.size() && mActors[ actorSlot.mIndex ].first == id ) {
+			return actorSlot.mIndex;
 		}
 	}
+	return kActorInvalid;
 }
 
-PxScene* Physx::getScene( uint32_t id ) const
+// Swaps the last free slot into this one's place, so claiming any 
+// free slot is constant time
+void Physx::removeFreeActorSlot( uint32_t slot )
 {
-	if ( mScenes.find( id ) != mScenes.end() ) {
-		return mScenes.at( id );
-	}
-	return nullptr;
+	uint32_t index					= mActorSlots[ slot ].mFreeIndex;
+	uint32_t last					= mFreeActorSlots.back();
+	mFreeActorSlots[ index ]		= last;
+	mActorSlots[ last ].mFreeIndex	= index;
+	mFreeActorSlots.pop_back();
+	mActorSlots[ slot ].mFreeIndex	= kActorSlotInUse;
 }
 
-const map<uint32_t, PxScene*>& Physx::getScenes() const
+PxRigidDynamic* Physx::getRigidDynamic( uint32_t id ) const
 {
-	return mScenes;
+	PxActor* actor = getActor( id );
+	return actor != nullptr && actor->getType() == PxActorType::eRIGID_DYNAMIC ? 
+		static_cast<PxRigidDynamic*>( actor ) : nullptr;
 }
 
-PxConvexMesh* Physx::createConvexMesh( const vector<vec3>& positions, PxConvexFlags flags )
+void Physx::releaseActorId( uint32_t id )
 {
-	if ( positions.empty() ) {
-		return nullptr;
+	size_t index = findActor( id );
+	if ( index == kActorInvalid ) {
+		return;
 	}
-	PxConvexMeshDesc desc;
-	desc.points.count	= (PxU32)positions.size();
-	desc.points.data	= (PxVec3*)&positions[ 0 ];
-	desc.points.stride	= sizeof( PxVec3 );
-	desc.flags			= flags;
-	
-	PxDefaultMemoryOutputStream buffer;
-	if ( !mCooking->cookConvexMesh( desc, buffer ) ) {
-		return nullptr;
+
+	// Move the last actor into the hole to keep the array dense
+	size_t last = mActors.size() - 1;
+	if ( index != last ) {
+		mActors[ index ]		= mActors[ last ];
+		mPreviousPoses[ index ]	= mPreviousPoses[ last ];
+		mActorSlots[ mActors[ index ].first & kActorIndexMask ].mIndex = (uint32_t)index;
 	}
-	
-	PxDefaultMemoryInputData input( buffer.getData(), buffer.getSize() );
-	return mPhysics->createConvexMesh( input );
+	mActors.pop_back();
+	mPreviousPoses.pop_back();
+	freeActorSlot( id );
 }
 
-PxTriangleMesh* Physx::createTriangleMesh( const vector<vec3>& positions, size_t numTriangles, vector<uint32_t> indices )
+// Drops an actor's use of a cached shape. The cache's own reference 
+// is released with the last one; actors still hold theirs until they 
+// are released.
+void Physx::releaseCachedShape( PxShape* shape )
 {
-	if ( positions.empty() ) {
-		return nullptr;
-	}
-	if ( indices.empty() ) {
-		CI_ASSERT( positions.size() % 3 == 0 );
-		uint32_t count = (uint32_t)positions.size();
-		for ( uint32_t i = 0; i < count; ++i ) {
-			indices.push_back( i );
-		}
-		numTriangles = indices.size() / 3;
-	}
-	
-	PxTriangleMeshDesc desc;
-	desc.points.count		= (PxU32)positions.size();
-	desc.points.data		= (PxVec3*)&positions[ 0 ];
-	desc.points.stride		= sizeof( PxVec3 );
-	desc.triangles.count	= (PxU32)numTriangles;
-	desc.triangles.data		= (PxU32*)&indices[ 0 ];
-	desc.triangles.stride	= sizeof( PxU32 ) * 3;
-	
-	PxDefaultMemoryOutputStream writeBuffer;
-	if ( !mCooking->cookTriangleMesh( desc, writeBuffer ) ) {
-		return nullptr;
+	map<const PxShape*, ShapeRef>::iterator iter = mShapeRefs.find( shape );
+	if ( iter != mShapeRefs.end() && iter->second.mNumActors > 0 && --iter->second.mNumActors == 0 ) {
+		mShapeCache.erase( iter->second.mKey );
+		mShapeRefs.erase( iter );
+		updateMaterialRefs( shape, false );
+		shape->release();
 	}
-	
-	PxDefaultMemoryInputData readBuffer( writeBuffer.getData(), writeBuffer.getSize() );
-	return mPhysics->createTriangleMesh( readBuffer );
 }
 
-#if !defined( CINDER_COCOA_TOUCH )
-void Physx::pvdConnect( const string& host, int32_t port, 
-						 int32_t timeout, PxVisualDebuggerConnectionFlags connectionFlags )
+// Tops up the IDs queueAddActor() hands out. Reserved slots stay off 
+// the free list until their actor is applied.
+void Physx::reserveActorIds()
 {
-	pvdDisconnect();
-	if ( mPhysics->getPvdConnectionManager() ) {
-		mPvdConnection = PxVisualDebuggerExt::createConnection( 
-			mPhysics->getPvdConnectionManager(), 
-			host.c_str(), port, timeout, connectionFlags );
+	if ( !mCommandQueue ) {
+		return;
+	}
+	while ( mCommandQueue->mNumReservedIds.load() < mCommandQueue->mCapacity ) {
+		uint32_t slot = 0;
+		if ( mFreeActorSlots.empty() ) {
+			if ( mActorSlots.size() >= kActorIndexMask ) {
+				break;
+			}
+			slot = addActorSlot();
+		} else {
+			slot = mFreeActorSlots.back();
+			removeFreeActorSlot( slot );
+		}
+
+		ActorSlot& actorSlot	= mActorSlots[ slot ];
+		actorSlot.mReserved		= true;
+		uint32_t id				= ( actorSlot.mGeneration << kActorIndexBits ) | slot;
+		++mCommandQueue->mNumReservedIds;
+		if ( !mCommandQueue->mIds.push( id ) ) {
+			--mCommandQueue->mNumReservedIds;
+			actorSlot.mReserved = false;
+			addFreeActorSlot( slot );
+			break;
+		}
 	}
 }
 
-void Physx::pvdDisconnect()
+void Physx::releaseDeletedActors()
 {
-	if ( mPhysics->getPvdConnectionManager() ) {
-		if ( mPvdConnection != nullptr ) {
-			if ( mPvdConnection->isConnected() ) {
-				mPvdConnection->disconnect();
+	if ( mNumClearedActors == 0 && mDeletedActors.empty() ) {
+		return;
+	}
+
+	mRemovedActors.clear();
+	for ( size_t i = 0; i < mNumClearedActors; ++i ) {
+		PxActor* actor = mActors[ i ].second;
+		mRemovedActors.push_back( make_pair( actor->getScene(), actor ) );
+	}
+	for ( uint32_t id : mDeletedActors ) {
+		size_t index = findActor( id );
+		if ( index != kActorInvalid && index >= mNumClearedActors ) {
+			PxActor* actor = mActors[ index ].second;
+			mRemovedActors.push_back( make_pair( actor->getScene(), actor ) );
+		}
+	}
+
+	// Pull actors out of each scene in one batch before releasing them
+	sort( mRemovedActors.begin(), mRemovedActors.end() );
+	vector<PxActor*> actors( mRemovedActors.size() );
+	for ( size_t i = 0; i < mRemovedActors.size(); ++i ) {
+		actors[ i ] = mRemovedActors[ i ].second;
+	}
+	for ( size_t i = 0; i < mRemovedActors.size(); ) {
+		PxScene* scene	= mRemovedActors[ i ].first;
+		size_t count	= 1;
+		while ( i + count < mRemovedActors.size() && mRemovedActors[ i + count ].first == scene ) {
+			++count;
+		}
+		if ( scene != nullptr ) {
+			scene->removeActors( &actors[ i ], (PxU32)count );
+		}
+		i += count;
+	}
+	// Pooled actors whose pool was cleared while they were out are 
+	// released like any other
+	for ( PxActor* actor : actors ) {
+		updateShapeRefs( actor, false );
+		map<const PxActor*, ActorPoolKey>::iterator iter = mActorPoolKeys.find( actor );
+		map<ActorPoolKey, ActorPool>::iterator pool = iter != mActorPoolKeys.end() ? 
+			mActorPool.find( iter->second ) : mActorPool.end();
+		if ( pool != mActorPool.end() ) {
+			pool->second.mActors.push_back( static_cast<PxRigidDynamic*>( actor ) );
+		} else {
+			if ( iter != mActorPoolKeys.end() ) {
+				mActorPoolKeys.erase( iter );
 			}
-			mPvdConnection->release();
-			mPvdConnection = nullptr;
+			actor->release();
 		}
-		if ( mPhysics->getPvdConnectionManager()->isConnected() ) {
-			mPhysics->getPvdConnectionManager()->disconnect();
+	}
+
+	// Individually erased actors are all behind the cleared range, so 
+	// swapping them out never disturbs it
+	for ( uint32_t id : mDeletedActors ) {
+		size_t index = findActor( id );
+		if ( index != kActorInvalid && index >= mNumClearedActors ) {
+			releaseActorId( id );
 		}
 	}
-}
+	mDeletedActors.clear();
 
-void Physx::onPvdSendClassDescriptions( PvdConnection& )
-{
+	// Drop the cleared range wholesale
+	if ( mNumClearedActors > 0 ) {
+		for ( size_t i = 0; i < mNumClearedActors; ++i ) {
+			freeActorSlot( mActors[ i ].first );
+		}
+		mActors.erase( mActors.begin(), mActors.begin() + mNumClearedActors );
+		mPreviousPoses.erase( mPreviousPoses.begin(), mPreviousPoses.begin() + mNumClearedActors );
+		for ( size_t i = 0; i < mActors.size(); ++i ) {
+			mActorSlots[ mActors[ i ].first & kActorIndexMask ].mIndex = (uint32_t)i;
+		}
+		mNumClearedActors = 0;
+	}
 }
 
-void Physx::onPvdConnected( PvdConnection& )
+void Physx::setShapeFilterData( PxRigidActor& actor, PxShape* shape, const PxFilterData& filterData )
 {
-	mPhysics->getVisualDebugger()->setVisualizeConstraints( true );
-	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_CONSTRAINTS,	true );
-	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_CONTACTS,		true );
-	mPhysics->getVisualDebugger()->setVisualDebuggerFlag( PxVisualDebuggerFlag::eTRANSMIT_SCENEQUERIES, true );
+	if ( mShapeRefs.find( shape ) == mShapeRefs.end() ) {
+		shape->setSimulationFilterData( filterData );
+		return;
+	}
+
+	// Changing a shared shape in place would change every actor using 
+	// it, so swap in the cached shape with the new filter data instead
+	PxMaterial* material = nullptr;
+	if ( shape->getMaterials( &material, 1 ) != 1 ) {
+		return;
+	}
+	PxShape* replacement = getShape( shape->getGeometry().any(), *material, filterData, shape->getFlags() );
+	if ( replacement == nullptr || replacement == shape ) {
+		return;
+	}
+	uintptr_t id		= (uintptr_t)actor.userData;
+	size_t index		= findActor( (uint32_t)id );
+	bool registered		= index != kActorInvalid && mActors[ index ].second == &actor;
+	if ( registered ) {
+		++mShapeRefs.find( replacement )->second.mNumActors;
+	}
+	actor.attachShape( *replacement );
+	actor.detachShape( *shape );
+	if ( registered ) {
+		releaseCachedShape( shape );
+	}
 }
 
-void Physx::onPvdDisconnected( PvdConnection& )
+// Cached materials are used through cached shapes, which count once 
+// each, or through a registered actor's own shapes
+void Physx::updateMaterialRefs( const PxShape* shape, bool acquire )
 {
+	if ( mMaterialRefs.empty() ) {
+		return;
+	}
+
+	// Shapes almost always have a single material
+	PxMaterial* buffer[ 8 ];
+	vector<PxMaterial*> overflow;
+	PxMaterial** materials	= buffer;
+	PxU32 count				= shape->getNbMaterials();
+	if ( count > 8 ) {
+		overflow.resize( count );
+		materials = &overflow[ 0 ];
+	}
+	count = shape->getMaterials( materials, count );
+	for ( PxU32 i = 0; i < count; ++i ) {
+		map<const PxMaterial*, MaterialRef>::iterator iter = mMaterialRefs.find( materials[ i ] );
+		if ( iter == mMaterialRefs.end() ) {
+			continue;
+		}
+		if ( acquire ) {
+			++iter->second.mNumUsers;
+		} else if ( iter->second.mNumUsers > 0 ) {
+			--iter->second.mNumUsers;
+		}
+	}
 }
-#endif
 
-PxErrorCallback& Physx::getErrorCallback()
+void Physx::updateShapeRefs( PxActor* actor, bool acquire )
 {
-	static PxDefaultErrorCallback defaultErrorCallback;
-	return defaultErrorCallback;
+	if ( ( mShapeRefs.empty() && mMaterialRefs.empty() ) || 
+		 ( actor->getType() != PxActorType::eRIGID_DYNAMIC && 
+		   actor->getType() != PxActorType::eRIGID_STATIC ) ) {
+		return;
+	}
+	const PxRigidActor* rigidActor = static_cast<const PxRigidActor*>( actor );
+	PxShape* shapes[ 8 ];
+	PxU32 numShapes = rigidActor->getNbShapes();
+	for ( PxU32 start = 0; start < numShapes; start += 8 ) {
+		PxU32 count = rigidActor->getShapes( shapes, 8, start );
+		for ( PxU32 i = 0; i < count; ++i ) {
+			map<const PxShape*, ShapeRef>::iterator iter = mShapeRefs.find( shapes[ i ] );
+			if ( iter == mShapeRefs.end() ) {
+				updateMaterialRefs( shapes[ i ], acquire );
+			} else if ( acquire ) {
+				++iter->second.mNumActors;
+			} else {
+				releaseCachedShape( shapes[ i ] );
+			}
+		}
+	}
 }
@@ -1,20 +1,43 @@
 #pragma once
 
 #include "cinder/AxisAlignedBox.h"
+#include "cinder/Filesystem.h"
 #include "cinder/Matrix.h"
 #include "cinder/Quaternion.h"
+#include "cinder/TriMesh.h"
 #include "PxPhysics.h"
 #include "PxPhysicsAPI.h"
 #include "extensions/PxExtensionsAPI.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
+// Shape filter data is read as word0 = groups the shape belongs to, 
+// word1 = groups it collides with, word2 = groups whose touches it 
+// wants reported. Zero groups or mask means "all". Pairs that don't 
+// collide are killed in the broadphase, and only pairs where one side 
+// asks for the other get notify flags.
 physx::PxFilterFlags FilterShader(
 	physx::PxFilterObjectAttributes, physx::PxFilterData,
 	physx::PxFilterObjectAttributes, physx::PxFilterData,
 	physx::PxPairFlags&, const void*, physx::PxU32 );
 
+// Passed to FilterShader through the scene's constant block. 
+// mNotifyFlags takes PxPairFlag::eNOTIFY_* bits; anything else is 
+// ignored.
+struct FilterShaderData
+{
+	FilterShaderData();
+
+	physx::PxU32									mNotifyFlags;
+};
+
 typedef std::shared_ptr<class Physx> PhysxRef;
 
 class Physx
@@ -23,6 +46,367 @@ class Physx
 #endif
 {
 public:
+	// Result of an async cook. get() blocks until cooking is done and 
+	// creates the mesh on first call. Once the Physx that created it is 
+	// destroyed, get() returns nullptr, so don't resolve a future while 
+	// its Physx is being destroyed on another thread.
+	template<typename T>
+	class MeshFuture
+	{
+	public:
+		MeshFuture();
+
+		T*											get();
+		bool										isReady() const;
+		bool										isValid() const;
+	protected:
+		struct										State;
+
+		MeshFuture( const std::shared_ptr<State>& state );
+
+		std::shared_ptr<State>						mState;
+
+		friend class								Physx;
+	};
+
+	typedef MeshFuture<physx::PxConvexMesh>			ConvexMeshFuture;
+	typedef MeshFuture<physx::PxTriangleMesh>		TriangleMeshFuture;
+
+	// Sorts rigid shapes into one bucket per geometry type and writes 
+	// packed per-instance data for instanced drawing. Scale maps a 
+	// unit-sized mesh centered on the origin onto the shape; capsules 
+	// run along x, as they do in PhysX. Storage is kept between frames. 
+	// Physx::getInstances() only refreshes what changed since its last 
+	// call, so it needs to see every update.
+	class InstanceBuckets
+	{
+	public:
+		struct Instance
+		{
+			ci::mat4								mModelMatrix;
+			ci::mat3								mNormalMatrix;
+		};
+
+		InstanceBuckets();
+
+		void										add( const physx::PxRigidActor& actor );
+		void										add( const physx::PxRigidActor& actor, 
+														 const physx::PxTransform& pose );
+		void										clear();
+		bool										contains( uint32_t id ) const;
+		void										erase( uint32_t id );
+		void										setPose( uint32_t id, const physx::PxTransform& pose );
+
+		size_t										getNumInstances( physx::PxGeometryType::Enum type ) const;
+		size_t										write( physx::PxGeometryType::Enum type, void* data, 
+														   size_t capacity, size_t stride = sizeof( Instance ) ) const;
+	protected:
+		struct Bucket
+		{
+			std::vector<uint32_t>					mIds;
+			std::vector<physx::PxTransform>			mLocalPoses;
+			mutable std::vector<ci::mat4>			mMatrices;
+			std::vector<physx::PxTransform>			mPoses;
+			std::vector<physx::PxVec3>				mScales;
+		};
+
+		// Bucket and index of one instance
+		typedef std::pair<physx::PxGeometryType::Enum, size_t>	Location;
+
+		Bucket										mBuckets[ physx::PxGeometryType::eGEOMETRY_COUNT ];
+		bool										mInterpolated;
+		std::map<uint32_t, std::vector<Location>>	mLocations;
+		std::vector<uint32_t>						mMovingIds;
+		uint32_t									mNumActorChanges;
+		const Physx*								mSource;
+
+		friend class								Physx;
+	};
+
+	// Simulation events are collected into fixed-size ring buffers per 
+	// scene while results are fetched and drained by the app afterward. 
+	// Actors are identified by their IDs; an actor PhysX reports as 
+	// deleted gets kInvalidId. Sleep and wake events are only sent for 
+	// actors with PxActorFlag::eSEND_SLEEP_NOTIFIES set.
+	static const uint32_t							kInvalidId = 0xffffffff;
+
+	struct ContactEvent
+	{
+		uint32_t									mActor0;
+		uint32_t									mActor1;
+		physx::PxPairFlags							mEvents;
+		physx::PxVec3								mImpulse;
+		physx::PxVec3								mNormal;
+		uint32_t									mNumPoints;
+		physx::PxVec3								mPoint;
+		uint32_t									mSceneId;
+	};
+
+	struct TriggerEvent
+	{
+		uint32_t									mOtherActor;
+		uint32_t									mSceneId;
+		physx::PxPairFlag::Enum						mStatus;
+		uint32_t									mTriggerActor;
+	};
+
+	struct SleepEvent
+	{
+		uint32_t									mActor;
+		bool										mAwake;
+		uint32_t									mSceneId;
+	};
+
+	// Batched scene queries. Each query reports its closest blocking hit, 
+	// or any hit for overlaps, into structure-of-arrays results that are 
+	// resized, never shrunk, so they can be reused every frame. Large 
+	// batches are split across the CPU dispatcher's workers, so don't 
+	// issue them from inside a dispatcher job. A step still in flight 
+	// on the queried scene is finished first.
+	struct RaycastQuery
+	{
+		physx::PxVec3								mDirection;
+		float										mDistance;
+		physx::PxVec3								mOrigin;
+	};
+
+	struct SweepQuery
+	{
+		physx::PxVec3								mDirection;
+		float										mDistance;
+		physx::PxGeometryHolder						mGeometry;
+		physx::PxTransform							mPose;
+	};
+
+	struct OverlapQuery
+	{
+		physx::PxGeometryHolder						mGeometry;
+		physx::PxTransform							mPose;
+	};
+
+	struct QueryResults
+	{
+		std::vector<uint32_t>						mActorIds;
+		std::vector<float>							mDistances;
+		std::vector<uint8_t>						mHits;
+		std::vector<physx::PxVec3>					mNormals;
+		std::vector<physx::PxVec3>					mPositions;
+	};
+
+	// Main-thread time spent in each stage of an update, in milliseconds. 
+	// Substeps within one update are summed.
+	enum StepTimer
+	{
+		STEP_DELETION, STEP_SIMULATE, STEP_FETCH, STEP_ACTIVE_TRANSFORMS, STEP_TIMER_COUNT
+	};
+
+	struct StepStats
+	{
+		StepStats();
+
+		double										getTotal() const;
+
+		uint32_t									mNumSteps;
+		double										mTimes[ STEP_TIMER_COUNT ];
+	};
+
+	// Rolling window of samples
+	class TimingHistory
+	{
+	public:
+		TimingHistory( size_t capacity = 240 );
+
+		void										add( double value );
+		void										clear();
+
+		double										getAverage() const;
+		std::vector<uint32_t>						getHistogram( size_t numBins, double maxValue ) const;
+		double										getMax() const;
+		size_t										getNumSamples() const;
+		double										getPercentile( double percentile ) const;
+	protected:
+		size_t										mNext;
+		std::vector<double>							mSamples;
+	};
+
+	// Size-class pool for small PhysX allocations. Blocks are 16-byte 
+	// aligned and recycled through per-class free lists, so steady-state 
+	// simulation stops hitting the system heap. Counters are kept per 
+	// type name and in total; Physx tells the foundation to report 
+	// names whenever it runs on a pool.
+	class PoolAllocator : public physx::PxAllocatorCallback
+	{
+	public:
+		struct Stats
+		{
+			Stats();
+
+			size_t									mAllocationsPerFrame;
+			size_t									mBytesLive;
+			size_t									mBytesPeak;
+			size_t									mNumAllocations;
+		};
+
+		PoolAllocator();
+		~PoolAllocator();
+
+		void*										allocate( size_t size, const char* typeName, 
+															  const char* filename, int line );
+		void										deallocate( void* ptr );
+
+		std::map<std::string, Stats>				getStats() const;
+		Stats										getTotalStats() const;
+		void										nextFrame();
+	protected:
+		struct Header;
+
+		// Each class has its own lock, so threads allocating different 
+		// sizes don't contend
+		struct SizeClass
+		{
+			SizeClass();
+
+			void*									mFreeBlocks;
+			std::mutex								mMutex;
+		};
+
+		struct TypeStats
+		{
+			TypeStats();
+
+			Stats									load() const;
+
+			std::atomic<size_t>						mAllocationsPerFrame;
+			std::atomic<size_t>						mBytesLive;
+			std::atomic<size_t>						mBytesPeak;
+			std::atomic<size_t>						mFrameAllocations;
+			std::atomic<const char*>				mName;
+			std::atomic<size_t>						mNumAllocations;
+		};
+
+		PoolAllocator( const PoolAllocator& );
+		PoolAllocator&								operator=( const PoolAllocator& );
+
+		uint32_t									getTypeIndex( const char* typeName );
+		static void									track( TypeStats& stats, size_t size );
+
+		std::mutex									mChunkMutex;
+		std::vector<void*>							mChunks;
+		std::unique_ptr<SizeClass[]>				mSizeClasses;
+		TypeStats									mTotalStats;
+		std::unique_ptr<TypeStats[]>				mTypeStats;
+	};
+
+	// Work-stealing thread pool behind the simulation. Each worker owns 
+	// a deque; it pops its own newest job first and steals the oldest 
+	// job from its neighbors when idle. submit() lets an application 
+	// run its own jobs on the same threads.
+	class CpuDispatcher : public physx::PxCpuDispatcher
+	{
+	public:
+		CpuDispatcher( uint32_t numThreads, 
+					   const std::vector<uint64_t>& affinityMasks = std::vector<uint64_t>() );
+		~CpuDispatcher();
+
+		physx::PxU32								getWorkerCount() const;
+		void										submit( const std::function<void()>& job );
+		void										submitTask( physx::PxBaseTask& task );
+	protected:
+		struct Worker;
+
+		CpuDispatcher( const CpuDispatcher& );
+		CpuDispatcher&								operator=( const CpuDispatcher& );
+
+		size_t										getWorkerIndex() const;
+		bool										pop( size_t index, std::function<void()>& job );
+		void										run( size_t index );
+
+		std::condition_variable						mCondition;
+		std::atomic<size_t>							mNextWorker;
+		std::atomic<size_t>							mNumPending;
+		bool										mRunning;
+		std::mutex									mSleepMutex;
+		std::vector<std::unique_ptr<Worker>>		mWorkers;
+	};
+
+	// Re-drives a Physx instance from a stream written by startRecording(). 
+	// Each step() applies recorded calls up to and including the next 
+	// update. Recorded actor and scene IDs are mapped to the IDs the 
+	// target instance hands out.
+	class Player
+	{
+	public:
+		Player( Physx& physx, const ci::fs::path& path );
+		~Player();
+
+		uint32_t									getActorId( uint32_t recordedId ) const;
+		size_t										getNumUpdates() const;
+		bool										isFinished() const;
+		bool										isValid() const;
+		bool										step();
+	protected:
+		Player( const Player& );
+		Player&										operator=( const Player& );
+
+		uint32_t									getSceneId( uint32_t recordedId ) const;
+		template<typename T> T						read();
+		void										readActor();
+		bool										readGeometry( physx::PxGeometryHolder& geometry );
+		void										readMesh( uint8_t opcode );
+
+		std::map<uint32_t, uint32_t>				mActorIds;
+		std::vector<uint8_t>						mData;
+		std::vector<physx::PxMaterial*>				mMaterials;
+		std::vector<physx::PxBase*>					mMeshes;
+		size_t										mNumUpdates;
+		size_t										mOffset;
+		Physx&										mPhysx;
+		std::map<uint32_t, uint32_t>				mSceneIds;
+		bool										mValid;
+	};
+
+	class Options
+	{
+	public:
+		Options();
+
+		Options&									allocator( physx::PxAllocatorCallback* allocator );
+		Options&									commandQueueSize( size_t count );
+		Options&									connectToPvd( bool enable = true );
+		Options&									cookingParams( const physx::PxCookingParams& params );
+		Options&									affinityMasks( const std::vector<uint64_t>& masks );
+		Options&									cpuDispatcher( physx::PxCpuDispatcher* dispatcher );
+		Options&									eventBufferSize( size_t count );
+		Options&									numThreads( uint32_t count );
+		Options&									poolAllocator( bool enable = true );
+		Options&									scale( const physx::PxTolerancesScale& scale );
+
+		physx::PxAllocatorCallback*					getAllocator() const;
+		const std::vector<uint64_t>&				getAffinityMasks() const;
+		size_t										getCommandQueueSize() const;
+		const physx::PxCookingParams&				getCookingParams() const;
+		physx::PxCpuDispatcher*						getCpuDispatcher() const;
+		size_t										getEventBufferSize() const;
+		uint32_t									getNumThreads() const;
+		const physx::PxTolerancesScale&				getScale() const;
+		bool										isConnectToPvdEnabled() const;
+		bool										isPoolAllocatorEnabled() const;
+	protected:
+		std::vector<uint64_t>						mAffinityMasks;
+		physx::PxAllocatorCallback*					mAllocator;
+		size_t										mCommandQueueSize;
+		bool										mConnectToPvd;
+		physx::PxCookingParams						mCookingParams;
+		bool										mCookingParamsSet;
+		physx::PxCpuDispatcher*						mCpuDispatcher;
+		size_t										mEventBufferSize;
+		uint32_t									mNumThreads;
+		bool										mPoolAllocator;
+		physx::PxTolerancesScale					mScale;
+	};
+
+	static PhysxRef									create( const Options& options );
+
 #if defined( CINDER_COCOA_TOUCH )
 	static PhysxRef									create();
 	static PhysxRef									create( const physx::PxTolerancesScale& scale );
@@ -46,6 +430,11 @@ public:
 	static ci::vec3									from( const physx::PxVec3& v );
 	static ci::vec4									from( const physx::PxVec4& v );
 	static ci::AxisAlignedBox						from( const physx::PxBounds3& b );
+	static void										from( const physx::PxTransform* transforms, ci::mat4* matrices, 
+														 size_t count );
+	static void										from( const physx::PxTransform* transforms, 
+														 const physx::PxBounds3* bounds, ci::mat4* matrices, 
+														 size_t count );
 
 	static physx::PxMat33							to( const ci::mat3& m );
 	static physx::PxMat44							to( const ci::mat4& m );
@@ -55,11 +444,16 @@ public:
 	static physx::PxVec4							to( const ci::vec4& v );
 	static physx::PxTransform						to( const ci::quat& q, const ci::vec3& v );
 	static physx::PxBounds3							to( const ci::AxisAlignedBox& b );
+	static void										to( const ci::mat4* matrices, physx::PxTransform* transforms, 
+													   size_t count );
 
-	physx::PxDefaultAllocator						getAllocator() const;
-	physx::PxActiveTransform*						getBufferedActiveTransforms() const;
+	static physx::PxTransform						interpolate( const physx::PxTransform& a, const physx::PxTransform& b, float alpha );
+
+	physx::PxAllocatorCallback&						getAllocator() const;
+	PoolAllocator*									getPoolAllocator() const;
+	const std::vector<physx::PxActiveTransform>&	getBufferedActiveTransforms( uint32_t sceneId = 0 ) const;
 	physx::PxCooking*								getCooking() const;
-	physx::PxDefaultCpuDispatcher*					getCpuDispatcher() const;
+	physx::PxCpuDispatcher*							getCpuDispatcher() const;
 #if PX_SUPPORT_GPU_PHYSX
 	physx::PxCudaContextManager*					getCudaContextManager() const;
 #endif
@@ -70,24 +464,161 @@ public:
 	physx::debugger::comm::PvdConnection*			getPvdConnection() const;
 #endif
 
+	void											beginUpdate( float deltaInSeconds = 1.0f / 60.0f );
+	void											endUpdate();
+	bool											isUpdateComplete() const;
+	bool											isUpdating() const;
 	void											update( float deltaInSeconds = 1.0f / 60.0f );
 
+	size_t											drainContactEvents( std::vector<ContactEvent>& events );
+	size_t											drainSleepEvents( std::vector<SleepEvent>& events );
+	size_t											drainTriggerEvents( std::vector<TriggerEvent>& events );
+	size_t											getNumDroppedEvents() const;
+
+	const physx::PxSimulationStatistics&			getSimulationStatistics( uint32_t sceneId = 0 ) const;
+	const TimingHistory&							getStepHistory( StepTimer timer ) const;
+	const StepStats&								getStepStats() const;
+
+	void											disableFixedTimestep();
+	void											enableFixedTimestep( float stepInSeconds = 1.0f / 60.0f, uint32_t maxSubsteps = 4 );
+	float											getFixedTimestep() const;
+	float											getInterpolationAlpha() const;
+	physx::PxTransform								getInterpolatedPose( uint32_t id ) const;
+	physx::PxTransform								getInterpolatedPose( const physx::PxRigidActor& actor ) const;
+	void											getInstances( InstanceBuckets& buckets ) const;
+	uint32_t										getMaxSubsteps() const;
+	bool											isFixedTimestepEnabled() const;
+
+	// Logs every state-changing call below to a compact binary stream 
+	// for Player, starting with the current scenes and actors. Changes 
+	// made directly on PhysX objects are not seen. Playback gives every 
+	// actor exclusive shapes and cooks meshes again from their vertices 
+	// and triangles with default flags, so mesh collision can differ.
+	bool											isRecording() const;
+	bool											startRecording( const ci::fs::path& path );
+	void											stopRecording();
+
+	// Actors that can't be given an ID because all of them are in use, 
+	// or whose scene doesn't exist, get kInvalidId and are left with 
+	// the caller
 	uint32_t										addActor( physx::PxActor* actor, uint32_t sceneId );
 	uint32_t										addActor( physx::PxActor* actor, physx::PxScene* scene );
+	void											addActors( physx::PxActor* const* actors, uint32_t count, 
+															   uint32_t sceneId, uint32_t* ids = nullptr );
+	void											addActors( physx::PxActor* const* actors, uint32_t count, 
+															   physx::PxScene* scene, uint32_t* ids = nullptr );
+	std::vector<uint32_t>							addActors( const std::vector<physx::PxActor*>& actors, uint32_t sceneId );
+	std::vector<uint32_t>							addActors( const std::vector<physx::PxActor*>& actors, physx::PxScene* scene );
 	void											clearActors();
 	void											eraseActor( uint32_t id );
 	void											eraseActor( physx::PxActor& actor );
 	void											eraseActor( physx::PxActor* actor );
 	physx::PxActor*									getActor( uint32_t id = 0 ) const;
-	const std::map<uint32_t, physx::PxActor*>&		getActors() const;
+	const std::vector<std::pair<uint32_t, physx::PxActor*>>&	getActors() const;
+
+	void											addForce( uint32_t id, const ci::vec3& force, 
+															  physx::PxForceMode::Enum mode = physx::PxForceMode::eFORCE );
+	void											addTorque( uint32_t id, const ci::vec3& torque, 
+															   physx::PxForceMode::Enum mode = physx::PxForceMode::eFORCE );
+	void											setAngularVelocity( uint32_t id, const ci::vec3& velocity );
+	void											setGlobalPose( uint32_t id, const physx::PxTransform& pose );
+	void											setKinematicTarget( uint32_t id, const physx::PxTransform& pose );
+	void											setLinearVelocity( uint32_t id, const ci::vec3& velocity );
+
+	// Lock-free versions of the calls above for worker threads, enabled 
+	// with Options::commandQueueSize(). Commands are applied in order at 
+	// the start of the next update. queueAddActor() returns the actor's 
+	// ID right away, from a reserve of IDs topped up each update. It 
+	// returns kInvalidId when the queue or the reserve runs out, and the 
+	// actor stays with the caller. The others return false when full.
+	uint32_t										queueAddActor( physx::PxActor* actor, uint32_t sceneId = 0 );
+	bool											queueEraseActor( uint32_t id );
+	bool											queueSetAngularVelocity( uint32_t id, const ci::vec3& velocity );
+	bool											queueSetGlobalPose( uint32_t id, const physx::PxTransform& pose );
+	bool											queueSetKinematicTarget( uint32_t id, const physx::PxTransform& pose );
+	bool											queueSetLinearVelocity( uint32_t id, const ci::vec3& velocity );
+
+	// Erasing an actor made by createPooledActor() parks it in a pool 
+	// keyed by geometry, material and density instead of releasing it. 
+	// The next request for the same key gets it back with a new pose and 
+	// velocity, with no allocation or shape creation. Actor and rigid 
+	// body flags, dominance group, damping, max angular velocity, solver 
+	// iterations, sleep threshold and mass are reset to what a new actor 
+	// has, forces are cleared and its shape is swapped back to the plain 
+	// cached one. Add pooled actors to a scene as usual and never 
+	// release them directly.
+	void											clearActorPool();
+	physx::PxRigidDynamic*							createPooledActor( const physx::PxGeometry& geometry, 
+																	  physx::PxMaterial& material, 
+																	  const physx::PxTransform& pose, float density = 1.0f, 
+																	  const ci::vec3& linearVelocity = ci::vec3( 0.0f ), 
+																	  const ci::vec3& angularVelocity = ci::vec3( 0.0f ) );
+	size_t											getNumPooledActors() const;
+	void											reserveActorPool( const physx::PxGeometry& geometry, 
+																	 physx::PxMaterial& material, size_t count, 
+																	 float density = 1.0f );
+
+	// Materials and shareable shapes interned by their parameters, so 
+	// bodies with the same size and surface share one shape instead of 
+	// each owning a copy. Attach cached shapes with attachShape() or the 
+	// PxShape overloads of PxCreateDynamic() and PxCreateStatic(). A 
+	// shape is released with the last registered actor using it, or by 
+	// trimShapeCache() if it was never used. Materials stay until 
+	// trimMaterialCache() finds no cached shape or registered actor 
+	// using them, so trim shapes first. Don't release or modify cached 
+	// objects directly; setFilterData() swaps shared shapes.
+	physx::PxMaterial*								getMaterial( float staticFriction = 0.5f, float dynamicFriction = 0.5f, 
+																 float restitution = 0.6f );
+	size_t											getNumCachedMaterials() const;
+	size_t											getNumCachedShapes() const;
+	physx::PxShape*									getShape( const physx::PxGeometry& geometry, physx::PxMaterial& material, 
+															  const physx::PxFilterData& filterData = physx::PxFilterData(), 
+															  physx::PxShapeFlags flags = physx::PxShapeFlag::eVISUALIZATION | 
+															  physx::PxShapeFlag::eSCENE_QUERY_SHAPE | 
+															  physx::PxShapeFlag::eSIMULATION_SHAPE );
+	void											trimMaterialCache();
+	void											trimShapeCache();
 
 	void											clearScenes();
 	uint32_t										createScene();
 	uint32_t										createScene( const physx::PxSceneDesc& desc );
+	uint32_t										createScene( const physx::PxSceneDesc& desc, 
+																const std::vector<physx::PxBounds3>& regions );
+	physx::PxSceneDesc								createSceneDesc( physx::PxBroadPhaseType::Enum broadPhaseType = 
+																	physx::PxBroadPhaseType::eMBP ) const;
 	void											eraseScene( uint32_t id );
 	void											eraseScene( physx::PxScene* scene );
 	physx::PxScene*									getScene( uint32_t id = 0 ) const;
 	const std::map<uint32_t, physx::PxScene*>&		getScenes() const;
+	int32_t											getScenePriority( uint32_t id ) const;
+	bool											isSceneEnabled( uint32_t id ) const;
+	void											setSceneEnabled( uint32_t id, bool enabled = true );
+	void											setScenePriority( uint32_t id, int32_t priority );
+
+	void											overlap( const OverlapQuery* queries, size_t count, QueryResults& results, 
+															 uint32_t sceneId = 0, 
+															 const physx::PxQueryFilterData& filterData = physx::PxQueryFilterData() );
+	void											raycast( const RaycastQuery* queries, size_t count, QueryResults& results, 
+															 uint32_t sceneId = 0, 
+															 const physx::PxQueryFilterData& filterData = physx::PxQueryFilterData() );
+	void											sweep( const SweepQuery* queries, size_t count, QueryResults& results, 
+														   uint32_t sceneId = 0, 
+														   const physx::PxQueryFilterData& filterData = physx::PxQueryFilterData() );
+
+	static physx::PxFilterData						createFilterData( uint32_t groups, uint32_t mask = 0xffffffff, 
+																	 uint32_t notifyMask = 0 );
+	const FilterShaderData&							getFilterShaderData() const;
+	void											setFilterData( physx::PxRigidActor& actor, 
+																  const physx::PxFilterData& filterData );
+	void											setFilterShaderData( const FilterShaderData& data );
+
+	static std::vector<physx::PxBounds3>			createBroadPhaseRegions( const ci::AxisAlignedBox& worldBounds, 
+																			uint32_t numSubdivisions, uint32_t upAxis = 1 );
+	static std::vector<physx::PxBounds3>			createBroadPhaseRegionsFromCellSize( const ci::AxisAlignedBox& worldBounds, 
+																						float cellSize, uint32_t upAxis = 1 );
+	uint32_t										addBroadPhaseRegion( const ci::AxisAlignedBox& bounds, uint32_t sceneId = 0, 
+																		bool populateRegion = true );
+	bool											removeBroadPhaseRegion( uint32_t handle, uint32_t sceneId = 0 );
 
 #if !defined( CINDER_COCOA_TOUCH )
 	void											pvdConnect( const std::string& host = "127.0.0.1", int32_t port = 5425, 
@@ -99,34 +630,271 @@ public:
 	
 	physx::PxConvexMesh*							createConvexMesh( const std::vector<ci::vec3>& positions,
 																	 physx::PxConvexFlags flags = physx::PxConvexFlag::eCOMPUTE_CONVEX );
+	physx::PxConvexMesh*							createConvexMesh( const physx::PxConvexMeshDesc& desc );
 	physx::PxTriangleMesh*							createTriangleMesh( const std::vector<ci::vec3>& positions,
 																	   size_t numTriangles = 0, 
-																	   std::vector<uint32_t> indices = std::vector<uint32_t>() );
+																	   const std::vector<uint32_t>& indices = std::vector<uint32_t>() );
+	physx::PxTriangleMesh*							createTriangleMesh( const ci::vec3* positions, size_t numPositions, 
+																	   size_t stride = sizeof( ci::vec3 ), 
+																	   const uint32_t* indices = nullptr, size_t numTriangles = 0 );
+	physx::PxTriangleMesh*							createTriangleMesh( const ci::vec3* positions, size_t numPositions, 
+																	   size_t stride, const uint16_t* indices, 
+																	   size_t numTriangles );
+	physx::PxTriangleMesh*							createTriangleMesh( const ci::TriMesh& mesh );
+	physx::PxTriangleMesh*							createTriangleMesh( const physx::PxTriangleMeshDesc& desc );
+
+	ConvexMeshFuture								createConvexMeshAsync( const std::vector<ci::vec3>& positions,
+																		  physx::PxConvexFlags flags = physx::PxConvexFlag::eCOMPUTE_CONVEX );
+	std::vector<ConvexMeshFuture>					createConvexMeshesAsync( const std::vector<std::vector<ci::vec3>>& positions,
+																			physx::PxConvexFlags flags = physx::PxConvexFlag::eCOMPUTE_CONVEX );
+	TriangleMeshFuture								createTriangleMeshAsync( const std::vector<ci::vec3>& positions,
+																			const std::vector<uint32_t>& indices = std::vector<uint32_t>() );
+	std::vector<TriangleMeshFuture>					createTriangleMeshesAsync( const std::vector<std::vector<ci::vec3>>& positions,
+																			  const std::vector<std::vector<uint32_t>>& indices = 
+																			  std::vector<std::vector<uint32_t>>() );
+
+	const ci::fs::path&								getCookingCacheDirectory() const;
+	void											setCookingCacheDirectory( const ci::fs::path& path );
+
+	// Snapshots are PhysX binary collections of a scene's actors, shapes, 
+	// materials and meshes. Loading maps the file and deserializes it in 
+	// place, so the mapping is held until this instance is destroyed. 
+	// Actors keep their saved IDs when those are free. A new scene is 
+	// created when sceneId is kInvalidId. Returns the scene ID, or 
+	// kInvalidId on failure.
+	uint32_t										loadSnapshot( const ci::fs::path& path, uint32_t sceneId = kInvalidId );
+	bool											saveSnapshot( uint32_t sceneId, const ci::fs::path& path );
 protected:
-#if defined( CINDER_COCOA_TOUCH )
-	Physx( const physx::PxTolerancesScale& scale, const physx::PxCookingParams& params );
-#else
-	Physx( const physx::PxTolerancesScale& scale, const physx::PxCookingParams& params, bool connectToPvd );
+	Physx( const Options& options );
 
+#if !defined( CINDER_COCOA_TOUCH )
 	virtual void									onPvdSendClassDescriptions( physx::debugger::comm::PvdConnection& );
 	virtual void									onPvdConnected( physx::debugger::comm::PvdConnection& );
 	virtual void									onPvdDisconnected( physx::debugger::comm::PvdConnection& );
 #endif
 
+	// Exact parameters of a geometry, compared field by field
+	struct GeometryKey
+	{
+		GeometryKey( const physx::PxGeometry& geometry );
+
+		bool										operator<( const GeometryKey& rhs ) const;
+
+		uint32_t									mFlags;
+		const void*									mMesh;
+		uint32_t									mType;
+		float										mValues[ 7 ];
+	};
+
+	// Pooled actors are only handed out for an exact match. The 
+	// material can't be recycled while a pooled actor's shape uses it, 
+	// so comparing its address is safe.
+	struct ActorPoolKey
+	{
+		ActorPoolKey( const physx::PxGeometry& geometry, const physx::PxMaterial* material, float density );
+
+		bool										operator<( const ActorPoolKey& rhs ) const;
+
+		float										mDensity;
+		GeometryKey									mGeometry;
+		const physx::PxMaterial*					mMaterial;
+	};
+
+	// What a recycled actor is reset to. Captured from the first actor 
+	// made for a pool key, while it still has PhysX's defaults.
+	struct ActorState
+	{
+		ActorState();
+		ActorState( const physx::PxRigidDynamic& actor );
+
+		void										apply( physx::PxRigidDynamic& actor ) const;
+
+		physx::PxActorFlags							mActorFlags;
+		float										mAngularDamping;
+		physx::PxTransform							mCenterOfMass;
+		physx::PxDominanceGroup						mDominanceGroup;
+		physx::PxVec3								mInertia;
+		float										mLinearDamping;
+		float										mMass;
+		float										mMaxAngularVelocity;
+		physx::PxU32								mMinPositionIters;
+		physx::PxU32								mMinVelocityIters;
+		float										mSleepThreshold;
+	};
+
+	// Holds one use of its cached shape, so parking the last actor of 
+	// a key or trimming the shape cache never evicts it
+	struct ActorPool
+	{
+		ActorPool();
+
+		std::vector<physx::PxRigidDynamic*>			mActors;
+		physx::PxShape*								mShape;
+		ActorState									mState;
+	};
+
+	struct ActorSlot
+	{
+		bool										mErased;
+		uint32_t									mFreeIndex;
+		uint32_t									mGeneration;
+		uint32_t									mIndex;
+		bool										mReserved;
+	};
+
+	class CommandQueue;
+	class EventCallback;
+	class Recorder;
+	struct BatchQuery;
+	struct Snapshot;
+
+	struct MaterialKey
+	{
+		MaterialKey( float staticFriction, float dynamicFriction, float restitution );
+
+		bool										operator<( const MaterialKey& rhs ) const;
+
+		float										mDynamicFriction;
+		float										mRestitution;
+		float										mStaticFriction;
+	};
+
+	// Counts cached shapes and registered actors' own shapes using a 
+	// cached material
+	struct MaterialRef
+	{
+		MaterialRef( const MaterialKey& key );
+
+		MaterialKey									mKey;
+		size_t										mNumUsers;
+	};
+
+	struct ShapeKey
+	{
+		ShapeKey( const physx::PxGeometry& geometry, const physx::PxMaterial* material, 
+				  const physx::PxFilterData& filterData, physx::PxShapeFlags flags );
+
+		bool										operator<( const ShapeKey& rhs ) const;
+
+		physx::PxFilterData							mFilterData;
+		physx::PxShapeFlags							mFlags;
+		GeometryKey									mGeometry;
+		const physx::PxMaterial*					mMaterial;
+	};
+
+	struct ShapeRef
+	{
+		ShapeRef( const ShapeKey& key );
+
+		ShapeKey									mKey;
+		size_t										mNumActors;
+	};
+
+	struct SceneInfo
+	{
+		SceneInfo();
+
+		std::vector<physx::PxActiveTransform>		mActiveTransforms;
+		std::vector<std::shared_ptr<BatchQuery>>	mBatchQueries;
+		bool										mEnabled;
+		std::shared_ptr<EventCallback>				mEventCallback;
+		uint32_t									mNumSteps;
+		int32_t										mPriority;
+		physx::PxSimulationStatistics				mStatistics;
+	};
+
+	class ThreadPool;
+
+	uint32_t										acquireActorId( physx::PxActor* actor, uint32_t preferredId = kInvalidId );
+	void											applyCommands();
+	std::vector<physx::PxU8>						cookConvexMesh( const physx::PxConvexMeshDesc& desc, 
+																   const ci::fs::path& cacheDirectory ) const;
+	std::vector<physx::PxU8>						cookTriangleMesh( const physx::PxTriangleMeshDesc& desc, 
+																	 const ci::fs::path& cacheDirectory ) const;
+	ThreadPool&										getCookingPool();
+	const ci::fs::path&								updateCookingCachePath();
+	const uint32_t*									getSequentialIndices( size_t count );
+	static ci::fs::path								getCookingCachePath( const ci::fs::path& directory, uint64_t key, 
+																		const std::string& extension );
+	void											writeCookingCache( const ci::fs::path& path, const physx::PxU8* data, 
+																	  physx::PxU32 size ) const;
+	bool											isSimulating( physx::PxScene* scene ) const;
+	void											beginStep( float deltaInSeconds );
+	uint32_t										addActorSlot();
+	void											addFreeActorSlot( uint32_t slot );
+	bool											claimActorSlot( uint32_t id );
+	void											bufferActiveTransforms( physx::PxScene* scene );
+	void											fetchScene( physx::PxScene* scene );
+	void											finishScene( physx::PxScene* scene );
+	void											finishStats();
+	ActorPool&										getActorPool( const ActorPoolKey& key, physx::PxShape* shape );
+	void											waitForScenes();
+	void											sortScenes();
 	physx::PxErrorCallback&							getErrorCallback();
-	std::map<uint32_t, physx::PxActor*>				mActors;
-	physx::PxDefaultAllocator						mAllocator;
+	size_t											findActor( uint32_t id ) const;
+	physx::PxRigidDynamic*							getRigidDynamic( uint32_t id ) const;
+	void											freeActorSlot( uint32_t id );
+	void											releaseActorId( uint32_t id );
+	void											releaseCachedShape( physx::PxShape* shape );
+	void											releaseDeletedActors();
+	void											removeFreeActorSlot( uint32_t slot );
+	void											reserveActorIds();
+	void											runBatchQueries( uint32_t sceneId, size_t count, QueryResults& results, 
+																	const std::function<void( BatchQuery&, size_t, size_t )>& run );
+	void											setShapeFilterData( physx::PxRigidActor& actor, physx::PxShape* shape, 
+																		const physx::PxFilterData& filterData );
+	void											updateMaterialRefs( const physx::PxShape* shape, bool acquire );
+	void											updateShapeRefs( physx::PxActor* actor, bool acquire );
+	float											mAccumulator;
+	std::map<ActorPoolKey, ActorPool>				mActorPool;
+	std::map<const physx::PxActor*, ActorPoolKey>	mActorPoolKeys;
+	std::vector<std::pair<uint32_t, physx::PxActor*>>	mActors;
+	std::vector<ActorSlot>							mActorSlots;
+	std::shared_ptr<std::atomic<bool>>				mAlive;
+	physx::PxAllocatorCallback*						mAllocator;
+	std::unique_ptr<CommandQueue>					mCommandQueue;
 	physx::PxCooking*								mCooking;
-	physx::PxDefaultCpuDispatcher*					mCpuDispatcher;
+	ci::fs::path									mCookingCacheDirectory;
+	uint64_t										mCookingCacheParams;
+	ci::fs::path									mCookingCachePath;
+	std::unique_ptr<ThreadPool>						mCookingPool;
+	physx::PxCpuDispatcher*							mCpuDispatcher;
 #if PX_SUPPORT_GPU_PHYSX
 	physx::PxCudaContextManager*					mCudaContextManager;
 #endif
 	std::vector<uint32_t>							mDeletedActors;
+	size_t											mEventBufferSize;
+	FilterShaderData								mFilterShaderData;
+	float											mFixedTimestep;
+	std::vector<uint32_t>							mFreeActorSlots;
 	physx::PxFoundation*							mFoundation;
+	std::map<MaterialKey, physx::PxMaterial*>		mMaterialCache;
+	std::map<const physx::PxMaterial*, MaterialRef>	mMaterialRefs;
+	uint32_t										mMaxSubsteps;
+	uint32_t										mNumActorChanges;
+	size_t											mNumClearedActors;
+	std::unique_ptr<physx::PxAllocatorCallback>		mOwnedAllocator;
+	std::unique_ptr<CpuDispatcher>					mOwnedCpuDispatcher;
 	physx::PxPhysics*								mPhysics;
+	PoolAllocator*									mPoolAllocator;
+	std::vector<physx::PxTransform>					mPreviousPoses;
+	std::vector<std::pair<physx::PxScene*, physx::PxActor*>>	mRemovedActors;
 	physx::PxProfileZoneManager*					mProfileZoneManager;
 #if !defined( CINDER_COCOA_TOUCH )
 	physx::debugger::comm::PvdConnection*			mPvdConnection;
 #endif
+	std::vector<physx::PxActor*>					mQueuedActors;
+	std::unique_ptr<Recorder>						mRecorder;
 	std::map<uint32_t, physx::PxScene*>				mScenes;
+	std::vector<physx::PxScene*>					mScenesByPriority;
+	std::map<uint32_t, SceneInfo>					mSceneInfo;
+	std::vector<uint32_t>							mSequentialIndices;
+	std::map<ShapeKey, physx::PxShape*>				mShapeCache;
+	std::map<const physx::PxShape*, ShapeRef>		mShapeRefs;
+	std::vector<physx::PxScene*>					mSimulatingScenes;
+	std::vector<std::unique_ptr<Snapshot>>			mSnapshots;
+	TimingHistory									mStepHistory[ STEP_TIMER_COUNT ];
+	StepStats										mStepStats;
+	StepStats										mStepStatsPending;
+	bool											mStepStatsReady;
 };